@@ -0,0 +1,443 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include "dromaius.h"
+
+// Instruction lengths, as the CPU executes them
+static const uint8_t opLength[256] = {
+	1,3,1,1,1,1,2,1,3,1,1,1,1,1,2,1, 1,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1,
+	2,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1, 2,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,3,3,3,1,2,1,1,1,3,2,3,3,2,1, 1,1,3,1,3,1,2,1,1,1,3,1,3,1,2,1,
+	2,1,1,1,1,1,2,1,2,1,3,1,1,1,2,1, 2,1,1,1,1,1,2,1,2,1,3,1,1,1,2,1,
+};
+
+// Whether an instruction changes A, which ends what we know about it
+static bool writesA(const uint8_t *inst)
+{
+	uint8_t op = inst[0];
+	switch (op) {
+		case 0x07: case 0x0A: case 0x0F: case 0x17: case 0x1A: case 0x1F:
+		case 0x27: case 0x2A: case 0x2F: case 0x3A: case 0x3C: case 0x3D:
+		case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE:
+		case 0xF0: case 0xF1: case 0xF2: case 0xF6: case 0xFA:
+			return true;
+		case 0xCB:
+			return (inst[1] & 0x07) == 7 and (inst[1] < 0x40 or inst[1] >= 0x80); // all but BIT
+		default:
+			return (op >= 0x78 and op <= 0x7F) or (op >= 0x80 and op <= 0xB7);
+	}
+}
+
+// Instructions after which execution doesn't continue with the next one
+static bool endsFlow(uint8_t op)
+{
+	switch (op) {
+		case 0xC3: case 0x18: case 0xC9: case 0xD9: case 0xE9: // JP, JR, RET, RETI, JP (HL)
+		case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: // undefined
+		case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+			return true;
+		default:
+			return false;
+	}
+}
+
+Analyzer::~Analyzer()
+{
+	stop();
+}
+
+void Analyzer::stop()
+{
+	if (worker.joinable()) {
+		cancel = true;
+		worker.join();
+	}
+}
+
+// Start analyzing the loaded ROM, or load the results from the cache
+void Analyzer::analyze(std::string const &romFilename)
+{
+	stop();
+	ready = false; // after the previous run is done setting it
+	cancel = false;
+
+	Memory &memory = emu->memory;
+	size_t bankCount = std::max(memory.romLen / ANALYZER_BANK_SIZE, (size_t)1);
+	std::vector<uint8_t> rom(bankCount * ANALYZER_BANK_SIZE + 2, 0);
+	memcpy(rom.data(), memory.rom, std::min(memory.romLen, bankCount * ANALYZER_BANK_SIZE));
+
+	// Reset and interrupt vectors, then every symbol in ROM
+	std::vector<std::pair<uint8_t, entry_t>> entries;
+	for (uint16_t addr : {0x0100, 0x0040, 0x0048, 0x0050, 0x0058, 0x0060}) {
+		entries.push_back({0, {addr, addr, 0}});
+	}
+	for (Symbols::symbol_t const &symbol : emu->symbols.byName) {
+		uint8_t bank = symbol.bank;
+		uint16_t addr = symbol.addr;
+		bool inBank = bank == 0 ? addr < 0x4000 : addr >= 0x4000 and addr < 0x8000;
+		if (inBank and bank < bankCount) {
+			entries.push_back({bank, {addr, addr, bank}});
+		}
+	}
+
+	// Results depend on the ROM and where the symbols are
+	uint64_t hash = 0xcbf29ce484222325;
+	for (uint8_t b : rom) {
+		hash = (hash ^ b) * 0x100000001b3;
+	}
+	for (auto const &entry : entries) {
+		hash = (hash ^ ((entry.first << 16) | entry.second.addr)) * 0x100000001b3;
+	}
+
+	worker = std::thread(&Analyzer::run, this, std::move(rom), std::move(entries), romFilename + ".analysis", hash);
+}
+
+void Analyzer::run(std::vector<uint8_t> rom, std::vector<std::pair<uint8_t, entry_t>> entries, std::string cacheFile, uint64_t hash)
+{
+	size_t bankCount = rom.size() / ANALYZER_BANK_SIZE;
+	banks.assign(bankCount, {});
+	for (bank_t &bank : banks) {
+		bank.map.assign(ANALYZER_BANK_SIZE, 0);
+	}
+
+	if (loadCache(cacheFile, hash)) {
+		printf("Loaded ROM analysis from '%s'\n", cacheFile.c_str());
+		count();
+		ready = true;
+		return;
+	}
+
+	std::vector<std::vector<entry_t>> queues(bankCount);
+	for (auto const &entry : entries) {
+		queues[entry.first].push_back(entry.second);
+	}
+
+	// Each round traces all banks with pending entries in parallel, on a
+	// pool of threads kept for all rounds. Jumps into other banks are
+	// collected and queued for the next round.
+	std::vector<std::vector<ref_t>> refs(bankCount);
+	std::vector<std::vector<std::pair<uint8_t, entry_t>>> outboxes(bankCount);
+	std::vector<uint8_t> pending;
+	std::atomic<size_t> next = 0;
+
+	auto traceBanks = [&] {
+		for (size_t i = next++; i < pending.size(); i = next++) {
+			uint8_t bank = pending[i];
+			traceBank(bank, rom.data(), queues[bank], outboxes[bank], refs[bank]);
+		}
+	};
+
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	uint32_t round = 0;
+	size_t working = 0;
+	bool finished = false;
+	auto work = [&] {
+		for (uint32_t seen = 0; ; ) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return finished or round != seen; });
+				if (finished) {
+					return;
+				}
+				seen = round;
+			}
+			traceBanks();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--working == 0) {
+				done.notify_one();
+			}
+		}
+	};
+
+	size_t threadCount = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), bankCount);
+	std::vector<std::thread> pool;
+	for (size_t t = 1; t < threadCount; t++) {
+		pool.emplace_back(work);
+	}
+
+	while (not cancel) {
+		pending.clear();
+		for (size_t bank = 0; bank < bankCount; bank++) {
+			if (not queues[bank].empty()) {
+				pending.push_back(bank);
+			}
+		}
+		if (pending.empty()) {
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			next = 0;
+			working = pool.size();
+			round++;
+		}
+		wake.notify_all();
+		traceBanks();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&] { return working == 0; });
+		}
+
+		for (auto &outbox : outboxes) {
+			for (auto const &entry : outbox) {
+				queues[entry.first].push_back(entry.second);
+			}
+			outbox.clear();
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = true;
+	}
+	wake.notify_all();
+	for (std::thread &thread : pool) {
+		thread.join();
+	}
+
+	// Incomplete results are neither used nor cached
+	if (cancel) {
+		return;
+	}
+
+	// Index the references by target, the call graph by caller
+	for (size_t bank = 0; bank < bankCount; bank++) {
+		for (ref_t const &ref : refs[bank]) {
+			banks[ref.toBank].refsTo.push_back(ref);
+		}
+	}
+	for (size_t bank = 0; bank < bankCount; bank++) {
+		auto &refsTo = banks[bank].refsTo;
+		std::sort(refsTo.begin(), refsTo.end(), [](ref_t const &a, ref_t const &b) {
+			return a.to != b.to ? a.to < b.to : a.fromBank != b.fromBank ? a.fromBank < b.fromBank : a.from < b.from;
+		});
+
+		auto &calls = banks[bank].calls;
+		std::sort(calls.begin(), calls.end(), [](ref_t const &a, ref_t const &b) {
+			return a.from != b.from ? a.from < b.from : a.toBank != b.toBank ? a.toBank < b.toBank : a.to < b.to;
+		});
+		calls.erase(std::unique(calls.begin(), calls.end(), [](ref_t const &a, ref_t const &b) {
+			return a.from == b.from and a.toBank == b.toBank and a.to == b.to;
+		}), calls.end());
+	}
+
+	saveCache(cacheFile, hash);
+	count();
+	printf("Analyzed ROM: %zu instructions, %zu functions\n", instructions, functions);
+	ready = true;
+}
+
+// Follow control flow from the queued entries of one bank. Only touches
+// this bank's results, anything for other banks goes to the outbox.
+void Analyzer::traceBank(uint8_t bank, const uint8_t *rom, std::vector<entry_t> &queue,
+	std::vector<std::pair<uint8_t, entry_t>> &outbox, std::vector<ref_t> &refs)
+{
+	uint8_t *map = banks[bank].map.data();
+	const uint8_t *bytes = rom + bank * ANALYZER_BANK_SIZE;
+	uint16_t base = bank ? 0x4000 : 0x0000;
+
+	while (not queue.empty() and not cancel) {
+		entry_t entry = queue.back();
+		queue.pop_back();
+
+		uint16_t addr = entry.addr;
+		uint8_t mapped = entry.mapped;
+		int knownA = -1;
+
+		while (addr >= base and addr < base + ANALYZER_BANK_SIZE) {
+			uint16_t offset = addr - base;
+			if (map[offset] & CODE) {
+				break; // been here
+			}
+
+			const uint8_t *inst = bytes + offset;
+			uint8_t op = inst[0];
+			uint8_t len = std::min((int)opLength[op], ANALYZER_BANK_SIZE - offset);
+			memset(map + offset, CODE, len);
+			map[offset] |= INSTRUCTION;
+
+			// Bank switches: LD A,n then LD (2000-3FFF),A
+			uint16_t operand = inst[1] | (inst[2] << 8);
+			if (op == 0xEA and operand >= 0x2000 and operand < 0x4000 and knownA >= 0) {
+				mapped = knownA ? knownA : 1;
+			}
+			if (op == 0x3E) {
+				knownA = inst[1];
+			} else if (writesA(inst)) {
+				knownA = -1;
+			}
+
+			// Control flow targets
+			int target = -1;
+			uint8_t kind = JUMP;
+			switch (op) {
+				case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+					target = operand;
+					break;
+				case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+					target = (uint16_t)(addr + 2 + (int8_t)inst[1]);
+					break;
+				case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+					target = operand;
+					kind = CALL;
+					break;
+				case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+					target = op - 0xC7;
+					kind = CALL;
+					break;
+			}
+
+			if (target >= 0 and target < 0x8000) {
+				uint8_t toBank = target < 0x4000 ? 0 : bank ? bank : mapped;
+				if (toBank and toBank >= banks.size()) {
+					toBank = 0, target = -1; // switched to a bank that doesn't exist
+				}
+
+				if (target >= 0 and (target < 0x4000 or toBank)) {
+					refs.push_back({addr, (uint16_t)target, bank, toBank, kind});
+
+					entry_t next = {(uint16_t)target, entry.function, toBank ? toBank : mapped};
+					if (kind == CALL) {
+						next.function = target;
+						banks[bank].calls.push_back({entry.function, (uint16_t)target, bank, toBank, CALL});
+						knownA = -1; // callees return anything
+					}
+
+					if (toBank == bank) {
+						map[target - base] |= kind == CALL ? CALL_TARGET : JUMP_TARGET;
+						queue.push_back(next);
+					} else {
+						outbox.push_back({toBank, next});
+					}
+				}
+			}
+
+			if (endsFlow(op)) {
+				break;
+			}
+			addr += len;
+		}
+	}
+}
+
+// Targets in other banks get their flag when that bank is traced
+uint8_t Analyzer::flags(uint8_t bank, uint16_t addr)
+{
+	if (bank >= banks.size()) {
+		return 0;
+	}
+	uint8_t f = banks[bank].map[addr & (ANALYZER_BANK_SIZE - 1)];
+	auto refs = referencesTo(bank, addr);
+	for (const ref_t *ref = refs.first; ref != refs.second; ref++) {
+		f |= ref->kind == CALL ? CALL_TARGET : JUMP_TARGET;
+	}
+	return f;
+}
+
+std::pair<const Analyzer::ref_t *, const Analyzer::ref_t *> Analyzer::referencesTo(uint8_t bank, uint16_t addr)
+{
+	if (bank >= banks.size()) {
+		return {nullptr, nullptr};
+	}
+	auto const &refs = banks[bank].refsTo;
+	auto range = std::equal_range(refs.begin(), refs.end(), ref_t{0, addr, 0, 0, 0},
+		[](ref_t const &a, ref_t const &b) { return a.to < b.to; });
+	return {refs.data() + (range.first - refs.begin()), refs.data() + (range.second - refs.begin())};
+}
+
+// Totals for the summary
+void Analyzer::count()
+{
+	instructions = 0;
+	functions = 0;
+	for (bank_t const &bank : banks) {
+		instructions += std::count_if(bank.map.begin(), bank.map.end(), [](uint8_t f) { return f & INSTRUCTION; });
+
+		// refsTo is sorted by target, count each called target once
+		for (size_t i = 0; i < bank.refsTo.size(); ) {
+			bool called = false;
+			size_t j = i;
+			for (; j < bank.refsTo.size() and bank.refsTo[j].to == bank.refsTo[i].to; j++) {
+				called = called or bank.refsTo[j].kind == CALL;
+			}
+			functions += called;
+			i = j;
+		}
+	}
+}
+
+// Cache file: magic, version, hash, bank count, then per bank the map and
+// both reference lists with their lengths
+bool Analyzer::loadCache(std::string const &filename, uint64_t hash)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (not file) {
+		return false;
+	}
+
+	uint32_t magic = 0, version = 0, bankCount = 0;
+	uint64_t fileHash = 0;
+	file.read((char *)&magic, sizeof(magic));
+	file.read((char *)&version, sizeof(version));
+	file.read((char *)&fileHash, sizeof(fileHash));
+	file.read((char *)&bankCount, sizeof(bankCount));
+	if (not file or magic != ANALYZER_CACHE_MAGIC or version != ANALYZER_CACHE_VERSION
+		or fileHash != hash or bankCount != banks.size()) {
+		return false;
+	}
+
+	for (bank_t &bank : banks) {
+		uint32_t refCount = 0, callCount = 0;
+		file.read((char *)bank.map.data(), ANALYZER_BANK_SIZE);
+		file.read((char *)&refCount, sizeof(refCount));
+		bank.refsTo.resize(refCount);
+		file.read((char *)bank.refsTo.data(), refCount * sizeof(ref_t));
+		file.read((char *)&callCount, sizeof(callCount));
+		bank.calls.resize(callCount);
+		file.read((char *)bank.calls.data(), callCount * sizeof(ref_t));
+	}
+
+	if (not file) {
+		for (bank_t &bank : banks) {
+			bank.map.assign(ANALYZER_BANK_SIZE, 0);
+			bank.refsTo.clear();
+			bank.calls.clear();
+		}
+		return false;
+	}
+	return true;
+}
+
+void Analyzer::saveCache(std::string const &filename, uint64_t hash)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (not file) {
+		printf("Can't write ROM analysis cache '%s'\n", filename.c_str());
+		return;
+	}
+
+	uint32_t magic = ANALYZER_CACHE_MAGIC, version = ANALYZER_CACHE_VERSION, bankCount = banks.size();
+	file.write((const char *)&magic, sizeof(magic));
+	file.write((const char *)&version, sizeof(version));
+	file.write((const char *)&hash, sizeof(hash));
+	file.write((const char *)&bankCount, sizeof(bankCount));
+
+	for (bank_t const &bank : banks) {
+		uint32_t refCount = bank.refsTo.size(), callCount = bank.calls.size();
+		file.write((const char *)bank.map.data(), ANALYZER_BANK_SIZE);
+		file.write((const char *)&refCount, sizeof(refCount));
+		file.write((const char *)bank.refsTo.data(), refCount * sizeof(ref_t));
+		file.write((const char *)&callCount, sizeof(callCount));
+		file.write((const char *)bank.calls.data(), callCount * sizeof(ref_t));
+	}
+}
@@ -0,0 +1,85 @@
+#ifndef INCLUDED_ANALYZER_H
+#define INCLUDED_ANALYZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+struct Dromaius;
+
+#define ANALYZER_BANK_SIZE 0x4000
+#define ANALYZER_CACHE_MAGIC 0x414D5244 // "DRMA"
+#define ANALYZER_CACHE_VERSION 1
+
+// Static analysis of the whole ROM: follows control flow from the reset
+// and interrupt vectors and all symbols, keeping track of which bank is
+// switched in. Finds which bytes are code, who references what and who
+// calls whom. Runs once per ROM on a background thread, banks in parallel,
+// and the results are cached next to the ROM.
+struct Analyzer
+{
+	// Per ROM byte
+	enum Flag : uint8_t {
+		CODE        = 0x01, // part of an instruction
+		INSTRUCTION = 0x02, // first byte of an instruction
+		JUMP_TARGET = 0x04,
+		CALL_TARGET = 0x08, // function entry
+	};
+
+	enum RefKind : uint8_t {
+		JUMP,
+		CALL,
+	};
+
+	// A control flow reference, bank 0 is 0000-3FFF, others 4000-7FFF
+	typedef struct ref_s {
+		uint16_t from;
+		uint16_t to;
+		uint8_t fromBank;
+		uint8_t toBank;
+		uint8_t kind;
+	} ref_t;
+
+	typedef struct bank_s {
+		std::vector<uint8_t> map; // Flag per byte
+		std::vector<ref_t> refsTo; // references into this bank, by target
+		std::vector<ref_t> calls; // call graph, functions in this bank to callees, by caller
+	} bank_t;
+
+	// Up-reference
+	Dromaius *emu;
+
+	std::vector<bank_t> banks; // only valid once ready
+	size_t instructions = 0;
+	size_t functions = 0;
+	std::atomic<bool> ready = false;
+	std::thread worker;
+	std::atomic<bool> cancel = false;
+
+	~Analyzer();
+
+	void analyze(std::string const &romFilename);
+	void stop();
+
+	// Lookups, only while ready
+	uint8_t flags(uint8_t bank, uint16_t addr);
+	std::pair<const ref_t *, const ref_t *> referencesTo(uint8_t bank, uint16_t addr);
+
+private:
+	typedef struct entry_s {
+		uint16_t addr;
+		uint16_t function; // entry of the function this code belongs to
+		uint8_t mapped; // bank in 4000-7FFF, 0 if unknown
+	} entry_t;
+
+	void run(std::vector<uint8_t> rom, std::vector<std::pair<uint8_t, entry_t>> entries, std::string cacheFile, uint64_t hash);
+	void count();
+	void traceBank(uint8_t bank, const uint8_t *rom, std::vector<entry_t> &queue,
+		std::vector<std::pair<uint8_t, entry_t>> &outbox, std::vector<ref_t> &refs);
+	bool loadCache(std::string const &filename, uint64_t hash);
+	void saveCache(std::string const &filename, uint64_t hash);
+};
+
+#endif
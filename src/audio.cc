@@ -1,8 +1,82 @@
 #include <cstring>
-#include <iostream>
 #include <cmath>
+#include <iostream>
+#include <algorithm>
 #include "dromaius.h"
 
+// Duty cycles as 8-step patterns, bit n is step n
+static const uint8_t dutyPatterns[4] = {0x01, 0x81, 0x87, 0x7E};
+
+// Wave channel volume codes as right shifts of the 4-bit sample
+static const uint8_t waveShift[4] = {4, 0, 1, 2};
+
+// Noise clock divisors in clock cycles, shifted left by the s bits
+static const uint8_t noiseDivisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+// One noise LFSR step, the 7-bit mode also feeds back into bit 6
+static inline uint16_t lfsrStep(uint16_t lfsr, bool narrow)
+{
+	uint16_t x = (lfsr ^ (lfsr >> 1)) & 1;
+	lfsr = (lfsr >> 1) | (x << 14);
+	if (narrow) {
+		lfsr = (lfsr & ~0x40) | (x << 6);
+	}
+	return lfsr;
+}
+
+// The LFSR is linear, so stepping it 2^k times is a fixed transform that
+// can be looked up per byte of state and combined with xor.
+// Indexed by [narrow][k][byte][value].
+static uint16_t lfsrJump[2][AUDIO_NOISE_JUMP_BITS][2][256];
+
+static void initNoiseTables()
+{
+	static bool done = false;
+	if (done) {
+		return;
+	}
+
+	for (int narrow = 0; narrow < 2; narrow++) {
+		for (int k = 0; k < AUDIO_NOISE_JUMP_BITS; k++) {
+			// Where each single state bit ends up after 2^k steps
+			uint16_t basis[15];
+			for (int bit = 0; bit < 15; bit++) {
+				uint16_t lfsr = 1 << bit;
+				for (int i = 0; i < (1 << k); i++) {
+					lfsr = lfsrStep(lfsr, narrow);
+				}
+				basis[bit] = lfsr;
+			}
+
+			for (int byte = 0; byte < 2; byte++) {
+				for (int v = 0; v < 256; v++) {
+					uint16_t result = 0;
+					for (int bit = 0; bit < 8 and byte * 8 + bit < 15; bit++) {
+						if (v & (1 << bit)) {
+							result ^= basis[byte * 8 + bit];
+						}
+					}
+					lfsrJump[narrow][k][byte][v] = result;
+				}
+			}
+		}
+	}
+
+	done = true;
+}
+
+// Step the LFSR n times (n < 2^AUDIO_NOISE_JUMP_BITS)
+static inline uint16_t lfsrAdvance(uint16_t lfsr, bool narrow, uint32_t n)
+{
+	for (int k = 0; n; k++, n >>= 1) {
+		if (n & 1) {
+			auto const &table = lfsrJump[narrow][k];
+			lfsr = table[0][lfsr & 0xFF] ^ table[1][lfsr >> 8];
+		}
+	}
+	return lfsr;
+}
+
 Audio::~Audio()
 {
 	SDL_CloseAudioDevice(dev);
@@ -11,15 +85,42 @@ Audio::~Audio()
 
 void Audio::initialize()
 {
+	initNoiseTables();
+
+	// Sound hardware starts out silent
+	memset(&ch1, 0, sizeof(ch1));
+	memset(&ch2, 0, sizeof(ch2));
+	memset(&ch3, 0, sizeof(ch3));
+	memset(&ch4, 0, sizeof(ch4));
+	memset(waveRam, 0, sizeof(waveRam));
+	isEnabled = false;
+	masterVol = 7;
+	routing = 0xFF;
+
+	cycle = 0;
+	sequencerTimer = AUDIO_SEQUENCER_PERIOD;
+	sequencerStep = 0;
+
+	blip.initialize(GB_CLOCK_RATE, AUDIO_NATIVE_RATE, cycle);
+	resampler.initialize(AUDIO_NATIVE_RATE, AUDIO_SAMPLE_RATE, emu->settings.audioQuality);
+	memset(channelOut, 0, sizeof(channelOut));
+	scopeStart = cycle / AUDIO_SCOPE_PERIOD;
+	memset(scopeFill, 0, sizeof(scopeFill));
+	memset(scopeLevel, 0, sizeof(scopeLevel));
+	queueFill = 0;
+	rateDrift = 0;
+	rateAdjust = 0;
+	fastForwarding = false;
+
 	if (not initialized) {
 		memset(&want, 0, sizeof(want));
 
-		want.freq = 48000;
-		want.format = AUDIO_S8;
+		want.freq = AUDIO_SAMPLE_RATE;
+		want.format = AUDIO_S16SYS;
 		want.channels = 1;
 		want.samples = 128;
-		want.userdata = this; // store reference to this for the callback
-		want.callback = reinterpret_cast<void (*)(void*, unsigned char*, int)>(&Audio::play_audio);
+		want.userdata = emu; // the callback only touches emulator-level buffers
+		want.callback = &Audio::play_audio;
 
 		dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
 		if (not dev) {
@@ -29,85 +130,102 @@ void Audio::initialize()
 		// Unpause audio device
 		SDL_PauseAudioDevice(dev, 0);
 
-		// Reset sample counter
-		sample_ctr = 0;
-
 		initialized = true;
 	}
 }
 
 void Audio::writeByte(uint8_t b, uint16_t addr)
 {
+	// Everything before this write still sounds the old way
+	runUntil(emu->cpu.c * 4);
+
+	if (addr >= 0xFF30 and addr <= 0xFF3F) {
+		waveRam[addr - 0xFF30] = b;
+		return;
+	}
+
 	switch (addr) {
 		// Channel 1
 		case 0xFF10:
 			ch1.sweepExp = b & 0x7; // bit 0-2
-			ch1.sweepDir = (b & 0x4) ? 1 : 0; // bit 3
-			ch1.sweepTime = (b & 0x70) >> 4; // bit 4-6 
+			ch1.sweepDir = (b & 0x8) ? 1 : 0; // bit 3
+			ch1.sweepTime = (b & 0x70) >> 4; // bit 4-6
 			break;
 
 		case 0xFF11:
-			ch1.soundLen = b & 0x3F; // bit 0-5
+			ch1.length = 64 - (b & 0x3F); // bit 0-5
 			ch1.duty = (b & 0xC0) >> 6; // bit 6-7
 			break;
 
 		case 0xFF12:
-			ch1.envSteps = b & 0x7; // bit 0-2
-			ch1.envDir = (b & 0x4) ? 1 : 0; // bit 3
-			ch1.envVol = (b & 0xF0) >> 4; // bit 4-7
+			ch1.env.steps = b & 0x7; // bit 0-2
+			ch1.env.dir = (b & 0x8) ? 1 : 0; // bit 3
+			ch1.env.initVol = (b & 0xF0) >> 4; // bit 4-7
+			ch1.dacEnabled = (b & 0xF8) != 0;
+			ch1.isEnabled = ch1.isEnabled and ch1.dacEnabled;
 			break;
 
 		case 0xFF13:
 			// lower 8 bits of 11
-			ch1.freq = (ch1.freq & 0xFF00) | b;
+			ch1.freq = (ch1.freq & 0x0700) | b;
 			break;
 
 		case 0xFF14:
-			if (b & 0x80) { // bit 7
-				ch1.isRestarted = 1;
-				ch1.ctr = 0;
-			}
 			ch1.isCont = (b & 0x40) == 0; // bit 6
 
 			// upper 3 bits of 11
 			ch1.freq = (ch1.freq & 0xFF) | ((b & 0x7) << 8);
+
+			if (b & 0x80) { // bit 7
+				triggerSquare(ch1);
+
+				ch1.sweepFreq = ch1.freq;
+				ch1.sweepTimer = ch1.sweepTime ? ch1.sweepTime : 8;
+				ch1.sweepEnabled = ch1.sweepTime or ch1.sweepExp;
+				if (ch1.sweepExp and sweepTarget() > 2047) {
+					ch1.isEnabled = false;
+				}
+			}
 			break;
 
 		// Channel 2
 		case 0xFF16:
-			ch2.soundLen = b & 0x3F; // bit 0-5
+			ch2.length = 64 - (b & 0x3F); // bit 0-5
 			ch2.duty = (b & 0xC0) >> 6; // bit 6-7
 			break;
 
 		case 0xFF17:
-			ch2.envSteps = b & 0x7; // bit 0-2
-			ch2.envDir = (b & 0x4) ? 1 : 0; // bit 3
-			ch2.envVol = (b & 0xF0) >> 4; // bit 4-7
+			ch2.env.steps = b & 0x7; // bit 0-2
+			ch2.env.dir = (b & 0x8) ? 1 : 0; // bit 3
+			ch2.env.initVol = (b & 0xF0) >> 4; // bit 4-7
+			ch2.dacEnabled = (b & 0xF8) != 0;
+			ch2.isEnabled = ch2.isEnabled and ch2.dacEnabled;
 			break;
 
 		case 0xFF18:
 			// lower 8 bits of 11
-			ch2.freq = (ch2.freq & 0xFF00) | b;
+			ch2.freq = (ch2.freq & 0x0700) | b;
 			break;
 
 		case 0xFF19:
-			if (b & 0x80) { // bit 7
-				ch2.isRestarted = 1;
-				ch2.ctr = 0;
-			}
 			ch2.isCont = (b & 0x40) == 0; // bit 6
 
 			// upper 3 bits of 11
 			ch2.freq = (ch2.freq & 0xFF) | ((b & 0x7) << 8);
+
+			if (b & 0x80) { // bit 7
+				triggerSquare(ch2);
+			}
 			break;
 
 		// Channel 3
 		case 0xFF1A:
-			ch3.isEnabled = (b & 0x80) ? 1 : 0; // bit 7
+			ch3.dacEnabled = (b & 0x80) ? 1 : 0; // bit 7
+			ch3.isEnabled = ch3.isEnabled and ch3.dacEnabled;
 			break;
 
 		case 0xFF1B:
-			ch3.soundLen = b;
+			ch3.length = 256 - b;
 			break;
 
 		case 0xFF1C:
@@ -117,204 +235,438 @@ void Audio::writeByte(uint8_t b, uint16_t addr)
 		case 0xFF1D:
 			// lower 8 bits of 11
 			ch3.freq = (ch3.freq & 0x0700) | b;
-			//printf("lower ch3: %x\n", );
 			break;
 
 		case 0xFF1E:
-			if (b & 0x80) { // bit 7
-				ch3.isRestarted = 1;
-				ch3.ctr = 0;
-				ch3.waveCtr = 0;
-			}
 			ch3.isCont = (b & 0x40) == 0; // bit 6
 
 			// upper 3 bits of 11
 			ch3.freq = (ch3.freq & 0xFF) | ((b & 0x7) << 8);
-			//printf("lower ch3\n");
 
+			if (b & 0x80) { // bit 7
+				ch3.isEnabled = ch3.dacEnabled;
+				if (ch3.length == 0) {
+					ch3.length = 256;
+				}
+				ch3.timer = (2048 - ch3.freq) * 2;
+				ch3.wavePos = 0;
+			}
 			break;
 
 		// Channel 4
 		case 0xFF20:
-			ch4.soundLen = b & 0x1F;
+			ch4.length = 64 - (b & 0x3F);
 			break;
 
 		case 0xFF21:
-			ch4.envSteps = b & 0x7; // bit 0-2
-			ch4.envDir = (b & 0x4) ? 1 : 0; // bit 3
-			ch4.envVol = (b & 0xF0) >> 4; // bit 4-7
+			ch4.env.steps = b & 0x7; // bit 0-2
+			ch4.env.dir = (b & 0x8) ? 1 : 0; // bit 3
+			ch4.env.initVol = (b & 0xF0) >> 4; // bit 4-7
+			ch4.dacEnabled = (b & 0xF8) != 0;
+			ch4.isEnabled = ch4.isEnabled and ch4.dacEnabled;
 			break;
 
 		case 0xFF22:
 			ch4.r = b & 0x7; // bit 0-2
+			ch4.narrow = (b & 0x8) ? 1 : 0; // bit 3
 			ch4.s = (b & 0xF0) >> 4; // bit 4-7
 			break;
 
 		case 0xFF23:
-			if (b & 0x80) { // bit 7
-				ch4.isRestarted = 1;
-				ch4.ctr = 0;
-			}
-
 			ch4.isCont = (b & 0x40) == 0; // bit 6
 
+			if (b & 0x80) { // bit 7
+				ch4.isEnabled = ch4.dacEnabled;
+				if (ch4.length == 0) {
+					ch4.length = 64;
+				}
+				ch4.env.volume = ch4.env.initVol;
+				ch4.env.timer = ch4.env.steps;
+				ch4.lfsr = 0x7FFF;
+				ch4.timer = noiseDivisors[ch4.r] << ch4.s;
+			}
 			break;
 
 
 		// Control regs
 		case 0xFF24:
-			//printf("TODO: write to master channel volumes / Vin\n");
+			// Mono output, use the louder side
+			masterVol = std::max(b & 0x07, (b & 0x70) >> 4);
 			break;
 
 		case 0xFF25:
-			ch1.isEnabled = (b & 0x01) | (b & 0x10);
-			ch2.isEnabled = (b & 0x02) | (b & 0x20);
-			ch3.isEnabled = (b & 0x04) | (b & 0x40);
-			ch4.isEnabled = (b & 0x08) | (b & 0x80);
+			routing = b;
 			break;
 
 		case 0xFF26:
 			isEnabled = (b & 0x80) ? 1 : 0;
+			if (not isEnabled) {
+				ch1.isEnabled = ch2.isEnabled = ch3.isEnabled = ch4.isEnabled = false;
+			}
 			break;
 	}
+
+	updateOutputs(cycle);
 }
 
-inline int8_t Audio::sinewave(uint32_t f, double t) const
+void Audio::triggerSquare(square_t &ch)
 {
-	return sin((2.0 * M_PI) * f * t) * 128;
+	ch.isEnabled = ch.dacEnabled;
+	if (ch.length == 0) {
+		ch.length = 64;
+	}
+	ch.timer = (2048 - ch.freq) * 4;
+	ch.env.volume = ch.env.initVol;
+	ch.env.timer = ch.env.steps;
 }
 
-inline int8_t Audio::squarewave(uint32_t f, double t, int8_t dutyline) const
+// X(t) = X(t-1) +/- X(t-1)/2^n
+uint16_t Audio::sweepTarget()
 {
-	return sinewave(f, t) > dutyline ? 127 : -127;
+	uint16_t delta = ch1.sweepFreq >> ch1.sweepExp;
+	return ch1.sweepDir ? ch1.sweepFreq - delta : ch1.sweepFreq + delta;
 }
 
-int8_t dutylines[4] = {-118, -90, 0, 90};
+void Audio::clockSweep()
+{
+	if (ch1.sweepTimer > 1) {
+		ch1.sweepTimer--;
+		return;
+	}
+	ch1.sweepTimer = ch1.sweepTime ? ch1.sweepTime : 8;
+
+	if (ch1.sweepEnabled and ch1.sweepTime) {
+		uint16_t freq = sweepTarget();
+		if (freq > 2047) {
+			ch1.isEnabled = false;
+		} else if (ch1.sweepExp) {
+			ch1.sweepFreq = ch1.freq = freq;
+			if (sweepTarget() > 2047) {
+				ch1.isEnabled = false;
+			}
+		}
+	}
+}
 
-void Audio::play_audio(uint8_t *stream, int len)
+void Audio::clockEnvelope(envelope_t &env)
 {
-	double t, f = 220;
-	int8_t ch_sample[4] = {0, 0, 0, 0};
-	int16_t tmp;
-
-	for (int i = 0; i < len; ++i) {
-		if (isEnabled) {
-			if (ch1.isEnabled) {
-				t = sample_ctr * (1.0 / have.freq);
-
-				if (ch1.isRestarted) {
-					ch1.isRestarted = 0;
-				} else {
-					// Check if we've run out of time
-					double ch1time = ch1.ctr * (1.0 / have.freq);
-					if (!ch1.isCont &&
-						ch1time > (64 - ch1.soundLen) * (1.0 / 256)) {
-
-						// Time is up, disable sound
-						ch1.isEnabled = 0;
-					} else {
-						// Sweep if enabled and enough time has passed
-						if (ch1.sweepTime != 0 &&
-							t - ch1.lastSweep > (ch1.sweepTime / 128.0)) {
-							// 
-							// X(t) = X(t-1) +/- X(t-1)/2^n
-							if (ch1.sweepDir == 0) {
-								ch1.freq += ch1.freq >> ch1.sweepExp;
-							} else {
-								ch1.freq -= ch1.freq >> ch1.sweepExp;
-							}
-
-							ch1.lastSweep = t;
-						}
+	if (env.steps == 0) {
+		return;
+	}
+	if (env.timer > 1) {
+		env.timer--;
+		return;
+	}
+	env.timer = env.steps;
 
-						f = 131072.0 / (2048.0 - ch1.freq);
-						ch_sample[0] = squarewave(f, t, dutylines[ch1.duty]);
-						++ch1.ctr;
-					}
-				}
-			}
+	if (env.dir and env.volume < 15) {
+		env.volume++;
+	} else if (not env.dir and env.volume > 0) {
+		env.volume--;
+	}
+}
 
-			if (ch2.isEnabled) {
-				// Check if we've run out of time
-				double ch2time = ch2.ctr * (1.0 / have.freq);
-				if (!ch2.isCont &&
-					ch2time > (64 - ch2.soundLen) * (1.0 / 256)) {
-
-					// Time is up, disable sound
-					ch2.isEnabled = 0;
-				} else {
-					f = 131072.0 / (2048.0 - ch2.freq);
-					ch_sample[1] = squarewave(f, t, dutylines[ch2.duty]);
-					++ch2.ctr;
-				}
+// 512 Hz: length at 256 Hz, sweep at 128 Hz, envelopes at 64 Hz
+void Audio::clockSequencer()
+{
+	if ((sequencerStep & 1) == 0) {
+		auto clockLength = [](bool &isEnabled, bool isCont, uint16_t &length) {
+			if (not isCont and length > 0 and --length == 0) {
+				isEnabled = false;
 			}
+		};
+		clockLength(ch1.isEnabled, ch1.isCont, ch1.length);
+		clockLength(ch2.isEnabled, ch2.isCont, ch2.length);
+		clockLength(ch3.isEnabled, ch3.isCont, ch3.length);
+		clockLength(ch4.isEnabled, ch4.isCont, ch4.length);
+	}
 
-			if (ch3.isEnabled) {
-				// Check if we've run out of time
-				double ch3time = ch3.ctr * (1.0 / have.freq);
-				if (!ch3.isCont &&
-					ch3time > (64 - ch3.soundLen) * (1.0 / 256)) {
+	if (sequencerStep == 2 or sequencerStep == 6) {
+		clockSweep();
+	}
 
-					// Time is up, disable sound
-					ch3.isEnabled = 0;
-				} else {
+	if (sequencerStep == 7) {
+		clockEnvelope(ch1.env);
+		clockEnvelope(ch2.env);
+		clockEnvelope(ch4.env);
+	}
 
-					double sps = have.freq / (65536.0 / (2048 - ch3.freq));
+	sequencerStep = (sequencerStep + 1) & 7;
+}
 
-					if (ch3.ctr > sps) {
-						++ch3.waveCtr;
-						ch3.ctr = 0;
-					}
+// Run the channel frequency timers, output changes land at the exact
+// clock cycle they happen
+void Audio::advanceChannels(uint32_t cycles)
+{
+	for (int i = 0; i < 2; i++) {
+		square_t &ch = i ? ch2 : ch1;
+		int32_t t = ch.timer;
+		while (t <= (int32_t)cycles) {
+			ch.dutyPos = (ch.dutyPos + 1) & 7;
+			updateOutput(i, cycle + t);
+			t += (2048 - ch.freq) * 4;
+		}
+		ch.timer = t - cycles;
+	}
 
-					//printf("sps = %f\n", sps);
+	int32_t t = ch3.timer;
+	while (t <= (int32_t)cycles) {
+		ch3.wavePos = (ch3.wavePos + 1) & 31;
+		uint8_t b = waveRam[ch3.wavePos >> 1];
+		ch3.sample = (ch3.wavePos & 1) ? (b & 0x0F) : (b >> 4);
+		updateOutput(2, cycle + t);
+		t += (2048 - ch3.freq) * 2;
+	}
+	ch3.timer = t - cycles;
 
-					ch_sample[2] = ((ch3.waveCtr % 2 == 0)
-						? (waveRam[ch3.waveCtr >> 1] & 0xF0) >> 8
-						: (waveRam[ch3.waveCtr >> 1] & 0xF0));
-					++ch3.ctr;
-				}
+	advanceNoise(cycles);
+}
+
+// The noise clock can run far above the output rate. Slow noise gets a
+// step per LFSR clock like the other channels; fast noise is advanced in
+// bulk once per output sample period through the jump tables.
+void Audio::advanceNoise(uint32_t cycles)
+{
+	if (not ch4.isEnabled or ch4.s >= 14) {
+		return; // shifts of 14 and 15 don't clock the LFSR
+	}
+
+	const uint32_t stride = blip.clockRate / blip.sampleRate;
+	int32_t period = noiseDivisors[ch4.r] << ch4.s;
+	int32_t t = ch4.timer;
+
+	if ((uint32_t)period >= stride) {
+		while (t <= (int32_t)cycles) {
+			ch4.lfsr = lfsrStep(ch4.lfsr, ch4.narrow);
+			updateOutput(3, cycle + t);
+			t += period;
+		}
+	} else {
+		for (uint32_t pos = 0; pos < cycles; ) {
+			int32_t end = std::min(pos + stride, cycles);
+			if (t <= end) {
+				uint32_t steps = (end - t) / period + 1;
+				t += steps * period;
+				ch4.lfsr = lfsrAdvance(ch4.lfsr, ch4.narrow, steps);
+				updateOutput(3, cycle + end);
 			}
+			pos = end;
+		}
+	}
 
-			/*
-			if (ch4.isEnabled) {
-				// Check if we've run out of time
-				double ch4time = ch4.ctr * (1.0 / have.freq);
-				if (!ch4.isCont &&
-					ch4time > (64 - ch4.soundLen) * (1.0 / 256)) {
-
-					// Time is up, disable sound
-					ch4.isEnabled = 0;
-				} else {
-					if (ch4.r == 0) {
-						ch4.r = 1;
-					}
-					double noisef = 524288.0 / (ch4.r << (ch4.s + 1));
+	ch4.timer = t - cycles;
+}
+
+// Current output of a channel, -15..15
+int8_t Audio::channelLevel(int ch)
+{
+	if (not isEnabled) {
+		return 0;
+	}
 
-					ch_sample[3] = rand() / 8;
+	switch (ch) {
+		case 0:
+		case 1: {
+			square_t const &sq = ch ? ch2 : ch1;
+			if (not sq.isEnabled) {
+				return 0;
+			}
+			bool high = (dutyPatterns[sq.duty] >> sq.dutyPos) & 1;
+			return high ? sq.env.volume : -sq.env.volume;
+		}
 
-					++ch4.ctr;
-				}
+		case 2:
+			if (not ch3.isEnabled) {
+				return 0;
+			}
+			return (ch3.sample >> waveShift[ch3.volume]) * 2 - (15 >> waveShift[ch3.volume]);
+
+		default:
+			if (not ch4.isEnabled) {
+				return 0;
 			}
-			*/
+			// Output is the inverted low bit
+			return (ch4.lfsr & 1) ? -ch4.env.volume : ch4.env.volume;
+	}
+}
+
+// Add a step to the output where a channel's contribution changed
+void Audio::updateOutput(int ch, uint64_t time)
+{
+	int8_t level = channelLevel(ch);
+	if (level != scopeLevel[ch]) {
+		captureScope(ch, time);
+		scopeLevel[ch] = level;
+	}
+
+	int32_t out = 0;
+	if (routing & (0x11 << ch)) {
+		out = level * (masterVol + 1);
+	}
+
+	if (out != channelOut[ch]) {
+		blip.addDelta(time, (out - channelOut[ch]) * 64.0f);
+		channelOut[ch] = out;
+	}
+}
+
+// Repeat the channel's level in the scope up to the given time
+void Audio::captureScope(int ch, uint64_t time)
+{
+	uint64_t end = time / AUDIO_SCOPE_PERIOD - scopeStart;
+	end = std::min(end, (uint64_t)AUDIO_SCOPE_STAGE);
+	if (end > scopeFill[ch]) {
+		memset(&scopeStage[ch][scopeFill[ch]], scopeLevel[ch], end - scopeFill[ch]);
+		scopeFill[ch] = end;
+	}
+}
 
+void Audio::updateOutputs(uint64_t time)
+{
+	for (int i = 0; i < 4; i++) {
+		updateOutput(i, time);
+	}
+}
+
+void Audio::runUntil(uint64_t target)
+{
+	while (cycle < target) {
+		// Step to the end or the next sequencer tick
+		uint32_t cycles = target - cycle < sequencerTimer ? target - cycle : sequencerTimer;
+
+		advanceChannels(cycles);
+		cycle += cycles;
+
+		sequencerTimer -= cycles;
+		if (sequencerTimer == 0) {
+			sequencerTimer = AUDIO_SEQUENCER_PERIOD;
+			clockSequencer();
+			updateOutputs(cycle);
+
+			// Don't let a long run overflow the blip buffer
+			if (blip.samplesAvailable(cycle) > BLIP_BUFFER_SIZE / 2) {
+				flushSamples();
+			}
 		}
+	}
+}
+
+void Audio::flushSamples()
+{
+	float samples[BLIP_BUFFER_SIZE];
+	float resampled[BLIP_BUFFER_SIZE];
+	int16_t out[BLIP_BUFFER_SIZE];
 
+	size_t count = blip.readSamples(samples, blip.samplesAvailable(cycle));
 
-		// Add everything together
-		tmp = ((double)ch_sample[0]
-			+ (double)ch_sample[1]
-			+ (ch3.volume == 0 ? 0.0 :
-				(double)(ch_sample[2] >> (ch3.volume - 1)))
-			+ (double)ch_sample[3]) * 32;
-		//stream[i] = (tmp >= 127 ? 127 : (tmp <= -128 ? -128 : tmp));
-		stream[i] = tmp;
+	// Publish channel levels for the oscilloscope
+	for (int ch = 0; ch < 4; ch++) {
+		captureScope(ch, cycle);
+		emu->scope[ch].pushMany(scopeStage[ch], scopeFill[ch]);
+		scopeFill[ch] = 0;
+	}
+	scopeStart = cycle / AUDIO_SCOPE_PERIOD;
+
+	uint32_t target = AUDIO_SAMPLE_RATE * emu->settings.audioLatency / 1000;
+	emu->audioTarget = target;
+
+	// Turbo makes samples faster than the device plays them. Once it ends,
+	// what's queued above the target would only be late.
+	bool fastForward = emu->cpu.fastForward;
+	if (fastForwarding and not fastForward) {
+		resyncRate();
+	}
+	fastForwarding = fastForward;
+
+	// Nothing queues up without a device or while muted in turbo, so
+	// there's no need to resample either
+	if (not dev or (fastForward and emu->settings.turboMute)) {
+		return;
+	}
 
-		// store for debugging
-		sampleHistory[0][emu->cpu.c % AUDIO_SAMPLE_HISTORY_SIZE] = ch_sample[0];
-		sampleHistory[1][emu->cpu.c % AUDIO_SAMPLE_HISTORY_SIZE] = ch_sample[1];
-		sampleHistory[2][emu->cpu.c % AUDIO_SAMPLE_HISTORY_SIZE] = ch_sample[2];
-		sampleHistory[3][emu->cpu.c % AUDIO_SAMPLE_HISTORY_SIZE] = ch_sample[3];
+	if (resampler.quality != emu->settings.audioQuality) {
+		resampler.initialize(AUDIO_NATIVE_RATE, AUDIO_SAMPLE_RATE, emu->settings.audioQuality);
+	}
+	// The queue says nothing about the clocks in turbo, leave the rate be
+	if (not fastForward) {
+		updateRate();
+	}
+
+	size_t produced = resampler.process(samples, count, resampled);
+	for (size_t i = 0; i < produced; i++) {
+		out[i] = std::clamp(resampled[i], -32768.0f, 32767.0f);
+	}
 
-		++sample_ctr;
+	// In turbo only fill up to the target and skip the rest, so it plays
+	// in pieces at normal pitch
+	size_t keep = produced;
+	if (fastForward) {
+		size_t queued = emu->audioBuffer.size();
+		keep = queued < target ? std::min(produced, target - queued) : 0;
 	}
+
+	// Full buffers drop samples
+	if (emu->audioBuffer.pushMany(out, keep) < keep) {
+		emu->audioOverruns++;
+		resyncRate();
+	}
+}
+
+// The device and emulation clocks drift apart. Produce slightly more or
+// fewer samples depending on how far the queue is from the target, so it
+// neither runs dry nor builds up latency.
+void Audio::updateRate()
+{
+	float target = emu->audioTarget;
+
+	// Callbacks take whole chunks, average over a few of them
+	queueFill += (emu->audioBuffer.size() - queueFill) * 0.1f;
+
+	// Proportional for quick reaction, integral for the steady clock drift.
+	// The integral holds while the correction is at its limit, otherwise it
+	// winds up and overshoots once the error turns.
+	float error = std::clamp((target - queueFill) / target, -1.0f, 1.0f);
+	float correction = error + rateDrift;
+	if (std::abs(correction) < 1.0f or correction * error < 0) {
+		rateDrift = std::clamp(rateDrift + error * 0.0005f, -1.0f, 1.0f);
+	}
+	rateAdjust = std::clamp(error + rateDrift, -1.0f, 1.0f) * AUDIO_RATE_ADJUST_MAX;
+	resampler.setRateScale(1.0 + rateAdjust);
+}
+
+// After turbo or an overrun the queue says nothing about the clocks. Drop
+// what's above the target and measure from there, keeping the drift.
+void Audio::resyncRate()
+{
+	emu->audioTrim = true;
+	queueFill = emu->audioTarget;
+}
+
+void Audio::play_audio(void *userdata, uint8_t *stream, int len)
+{
+	Dromaius *emu = (Dromaius *)userdata;
+	int16_t *samples = (int16_t *)stream;
+	size_t count = len / sizeof(int16_t);
+
+	if (emu->audioTrim.exchange(false)) {
+		size_t queued = emu->audioBuffer.size();
+		if (queued > emu->audioTarget) {
+			emu->audioBuffer.discard(queued - emu->audioTarget);
+		}
+	}
+
+	// After running dry, wait for the target latency to build up again
+	size_t got = 0;
+	if (not emu->audioStarved or emu->audioBuffer.size() >= emu->audioTarget) {
+		got = emu->audioBuffer.popMany(samples, count);
+		if (got < count and not emu->audioStarved) {
+			emu->audioUnderruns++;
+		}
+		emu->audioStarved = got < count;
+	}
+
+	// Underruns play silence
+	memset(samples + got, 0, (count - got) * sizeof(int16_t));
+
+	emu->samplesPlayed += count;
 }
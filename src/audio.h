@@ -2,104 +2,120 @@
 #define INCLUDED_AUDIO_H
 
 #include <cstdint>
+#include "blip.h"
+#include "resampler.h"
 struct Dromaius;
 
-#define AUDIO_SAMPLE_HISTORY_SIZE 256
+#define AUDIO_SAMPLE_RATE         48000  // device rate
+#define AUDIO_NATIVE_RATE         131072 // synthesis rate, clock rate / 32
+#define AUDIO_BUFFER_SIZE         8192 // samples queued for the device, power of two
+#define AUDIO_SEQUENCER_PERIOD    8192 // clock cycles per frame sequencer step (512 Hz)
+#define AUDIO_NOISE_JUMP_BITS     8    // noise LFSR can jump up to 255 steps at once
+#define AUDIO_RATE_ADJUST_MAX     0.005f // resampling ratio correction, +-0.5%
+#define AUDIO_SCOPE_PERIOD        256  // clock cycles per oscilloscope sample
+#define AUDIO_SCOPE_RATE          (4194304 / AUDIO_SCOPE_PERIOD) // 16384 Hz
+#define AUDIO_SCOPE_SIZE          4096 // captured samples per channel, power of two
+#define AUDIO_SCOPE_STAGE         1024 // samples captured between flushes
 
 struct Audio
 {
 	Dromaius *emu;
 
-	struct channel1_t {
+	// Volume envelope, used by channel 1, 2 and 4
+	struct envelope_t {
+		uint8_t initVol; // bit 4-7
+		uint8_t dir;     // bit 3, 1 = louder
+		uint8_t steps;   // bit 0-2, period in 64 Hz ticks, 0 = off
+		uint8_t volume;
+		uint8_t timer;
+	};
+
+	// Channel 1 and 2
+	struct square_t {
 		bool isEnabled;
-		bool isRestarted;
-		uint32_t ctr;
+		bool dacEnabled;
+		bool isCont;     // false: stop when length runs out
+		uint16_t length; // 256 Hz ticks left
+		uint16_t freq;
+		int32_t timer;   // clock cycles until the next duty step
 
-		// Duty (4 bits)
+		// Duty (2 bits)
 		uint8_t duty;
+		uint8_t dutyPos;
+
+		envelope_t env;
 
-		// Sweep
+		// Sweep, channel 1 only
 		uint8_t sweepTime;
 		uint8_t sweepDir;
 		uint8_t sweepExp;
-		double lastSweep;
-
-		// Envelope
-		uint8_t envVol;
-		uint8_t envDir;
-		uint8_t envSteps;
-
-		// General
-		uint8_t soundLen;
-		uint16_t freq;
-		bool isCont;
-	} ch1;
+		uint8_t sweepTimer;
+		uint16_t sweepFreq;
+		bool sweepEnabled;
+	} ch1, ch2;
 
-	struct channel2_t {
+	struct wave_t {
 		bool isEnabled;
-		bool isRestarted;
-		uint32_t ctr;
-
-		// Duty (4 bits)
-		uint8_t duty;
-
-		// Envelope
-		uint8_t envVol;
-		uint8_t envDir;
-		uint8_t envSteps;
-
-		// General
-		uint8_t soundLen;
-		uint16_t freq;
+		bool dacEnabled;
 		bool isCont;
-	} ch2;
-
-	struct channel3_t {
-		bool isEnabled;
-		bool isRestarted;
-		uint32_t ctr;
-		uint32_t waveCtr;
-
-		// General
-		uint8_t volume;
-		uint8_t soundLen;
+		uint16_t length;
 		uint16_t freq;
-		bool isCont;
+		int32_t timer;
+
+		uint8_t volume;  // 0 = mute, 1 = 100%, 2 = 50%, 3 = 25%
+		uint8_t wavePos; // nibble in wave RAM
+		uint8_t sample;
 	} ch3;
 
-	struct channel4_t {
+	struct noise_t {
 		bool isEnabled;
-		bool isRestarted;
-		uint32_t ctr;
+		bool dacEnabled;
+		bool isCont;
+		uint16_t length;
 
 		// Freq spec
 		uint8_t s;
 		uint8_t r;
-		// TODO: bit 3 (softness?)
-
-		// Envelope
-		uint8_t envVol;
-		uint8_t envDir;
-		uint8_t envSteps;
+		bool narrow;     // bit 3, 7-bit LFSR
+		int32_t timer;   // clock cycles until the next LFSR step
+		uint16_t lfsr;
 
-		// General
-		uint8_t soundLen;
-		bool isCont;
+		envelope_t env;
 	} ch4;
 
-	// TODO: channel / sound selection (FF25)
-	// TODO: master channel volumes / Vin (FF24)
+	// Control regs
+	bool isEnabled;
+	uint8_t masterVol; // FF24, louder of both sides
+	uint8_t routing;   // FF25, a channel plays if routed to either side
+	uint8_t waveRam[16]; // 32 nibbles
+
+	// Timing, all in clock cycles
+	uint64_t cycle;         // emulated up to here
+	uint32_t sequencerTimer;
+	uint8_t sequencerStep;
+
+	// Output, channel level changes become band-limited steps at the
+	// native rate, which are then resampled to the device rate
+	BlipBuffer blip;
+	Resampler resampler;
+	int32_t channelOut[4];  // contribution to the mix, as last added to blip
+
+	// Rate control, keeps the device queue at the target latency
+	float queueFill;  // smoothed queued samples
+	float rateDrift;  // integrated error, the clock mismatch that remains
+	float rateAdjust; // current correction, positive produces more samples
+	bool fastForwarding; // as of the last flush
+
+	// Channel levels for the oscilloscope, staged until the next flush
+	uint64_t scopeStart; // scope sample of scopeStage[..][0]
+	uint16_t scopeFill[4];
+	int8_t scopeLevel[4]; // level since the last change
+	int8_t scopeStage[4][AUDIO_SCOPE_STAGE];
 
 	SDL_AudioSpec want;
 	SDL_AudioSpec have;
 	SDL_AudioDeviceID dev;
 
-	bool isEnabled;
-	uint8_t waveRam[16]; // 32 nibbles
-	uint32_t sample_ctr;
-
-	uint8_t sampleHistory[4][AUDIO_SAMPLE_HISTORY_SIZE]; // for debugging
-
 	bool initialized = false;
 
 	~Audio();
@@ -108,12 +124,30 @@ struct Audio
 
 	void writeByte(uint8_t b, uint16_t addr);
 
-	inline int8_t sinewave(uint32_t f, double t) const;
-	inline int8_t squarewave(uint32_t f, double t, int8_t dutyline) const;
-
-	// SDL callback
-	void play_audio(uint8_t *stream, int len);
+	// Emulate up to the given clock cycle
+	void runUntil(uint64_t target);
+
+	// Send finished samples to the audio device
+	void flushSamples();
+
+	// SDL callback, only copies samples out of the buffer
+	static void play_audio(void *userdata, uint8_t *stream, int len);
+
+private:
+	void advanceChannels(uint32_t cycles);
+	void advanceNoise(uint32_t cycles);
+	void clockSequencer();
+	void clockEnvelope(envelope_t &env);
+	void clockSweep();
+	uint16_t sweepTarget();
+	void triggerSquare(square_t &ch);
+	int8_t channelLevel(int ch);
+	void updateOutput(int ch, uint64_t time);
+	void updateOutputs(uint64_t time);
+	void updateRate();
+	void resyncRate();
+	void captureScope(int ch, uint64_t time);
 };
 
 
-#endif
\ No newline at end of file
+#endif
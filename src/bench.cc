@@ -0,0 +1,693 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include "dromaius.h"
+
+// Microbenchmarks for the emulation's hot paths, run by `make bench`:
+//   dromaius-bench [--filter text] [--reps n] [--min-time ms] [--json file] [--list]
+// Each benchmark is calibrated to run for at least --min-time per
+// repetition, then repeated. Reported are the median, the fastest
+// repetition and the median absolute deviation, all in ns per operation.
+// Inputs come from a fixed seed, so runs on one machine compare.
+//
+// With `make SIMD=1`, `dromaius-bench --verify-renderers` checks instead
+// that the span renderer draws the same pixels as the plain one.
+
+#define BENCH_REPS         15
+#define BENCH_MIN_TIME_MS  20
+#define BENCH_NOISY        2.0 // percent deviation that marks a result as noisy
+#define BENCH_ROM_BANKS    128 // 2 MiB, any MBC1 or MBC3 bank number is valid
+#define BENCH_SYMBOLS      20000
+#define BENCH_SEED         0x12345678
+#define BENCH_VERIFY_STATES 1000
+#define BENCH_VERIFY_SHOWN  10 // mismatches printed in full
+
+typedef struct bench_s {
+	std::string name;
+	std::function<void()> setup;
+	std::function<void(uint64_t ops)> run;
+} bench_t;
+
+typedef struct result_s {
+	std::string name;
+	uint64_t ops; // per repetition
+	double median; // ns per op
+	double min;
+	double deviation; // median absolute deviation, percent of the median
+} result_t;
+
+static Dromaius *emu;
+static volatile uint64_t sink; // keeps results from being optimized away
+static uint32_t seed;
+
+static uint32_t nextRandom()
+{
+	seed = seed * 1664525 + 1013904223;
+	return seed >> 8;
+}
+
+// A cartridge without a file, the header fields are set directly
+static void loadRom(Memory::MBC mbc, uint8_t ramSize)
+{
+	Memory &memory = emu->memory;
+	memory.unloadRom();
+	emu->reset();
+
+	memory.romLen = BENCH_ROM_BANKS * 0x4000;
+	memory.rom = new uint8_t[memory.romLen];
+	for (size_t i = 0; i < memory.romLen; i++) {
+		memory.rom[i] = nextRandom();
+	}
+	memory.romLoaded = true;
+	memory.biosLoaded = false;
+	memory.mbc = mbc;
+	memory.ramSize = ramSize;
+}
+
+// Fills the ROM from 0x0150 with pieces of code picked at random by the
+// mix, which returns the length of the piece it wrote. Runs in a loop.
+typedef int (*mix_t)(uint8_t *out, uint16_t pc);
+
+static void loadMix(mix_t mix)
+{
+	seed = BENCH_SEED;
+	loadRom(Memory::MBC::NONE, 0);
+	uint8_t *rom = emu->memory.rom;
+
+	memset(rom, 0x00, 0x8000);
+	rom[0x0008] = 0xC9; // RST 08: RET
+	rom[0x0080] = 0xC9; // CALL 0080: RET
+	memcpy(rom + 0x0100, "\x00\xC3\x50\x01", 4); // NOP, JP 0150
+
+	uint16_t pc = 0x0150;
+	memcpy(rom + pc, "\x21\x00\xC0", 3); // LD HL, C000
+	pc += 3;
+	while (pc < 0x7FF0) {
+		pc += mix(rom + pc, pc);
+	}
+	memcpy(rom + pc, "\xC3\x50\x01", 3); // JP 0150
+
+	emu->cpu.r.pc = 0x0150;
+}
+
+// Register to register arithmetic and loads, no memory access
+static int aluMix(uint8_t *out, uint16_t pc)
+{
+	uint32_t r = nextRandom();
+	uint8_t op;
+	switch (r % 4) {
+		case 0: // ALU A, r
+			op = 0x80 + (r >> 4) % 0x40;
+			out[0] = (op & 7) == 6 ? op + 1 : op;
+			return 1;
+		case 1: // ALU A, n
+			out[0] = 0xC6 + ((r >> 4) % 8) * 8;
+			out[1] = r >> 12;
+			return 2;
+		case 2: // INC/DEC r
+			op = 0x04 + ((r >> 4) % 8) * 8 + ((r >> 8) & 1);
+			out[0] = op == 0x34 or op == 0x35 ? op + 8 : op;
+			return 1;
+		default: // LD r, r
+			op = 0x40 + (r >> 4) % 0x40;
+			out[0] = (op & 7) == 6 or (op & 0x38) == 0x30 ? 0x78 : op; // not via HL
+			return 1;
+	}
+}
+
+// Loads and stores through HL into WRAM, absolute and HRAM accesses, stack
+static int loadStoreMix(uint8_t *out, uint16_t pc)
+{
+	static const uint8_t viaHL[] = {0x7E, 0x46, 0x4E, 0x56, 0x5E, 0x77, 0x70, 0x71, 0x72, 0x73, 0x34, 0x35, 0x23, 0x22};
+	uint32_t r = nextRandom();
+	switch (r % 5) {
+		case 0:
+		case 1:
+			out[0] = viaHL[(r >> 4) % sizeof(viaHL)];
+			return 1;
+		case 2: // LD (nn), A or LD A, (nn) in WRAM
+			out[0] = (r >> 4) & 1 ? 0xEA : 0xFA;
+			out[1] = r >> 8;
+			out[2] = 0xC0 + ((r >> 16) & 0x1F);
+			return 3;
+		case 3: // LDH (n), A or LDH A, (n) in HRAM
+			out[0] = (r >> 4) & 1 ? 0xE0 : 0xF0;
+			out[1] = 0x80 + ((r >> 8) & 0x3F);
+			return 2;
+		default: // PUSH/POP
+			out[0] = 0xC5 + ((r >> 4) % 3) * 0x10;
+			out[1] = out[0] - 4;
+			return 2;
+	}
+}
+
+// CB prefixed rotates, shifts and bit operations on registers
+static int cbMix(uint8_t *out, uint16_t pc)
+{
+	uint32_t r = nextRandom();
+	uint8_t op = r >> 4;
+	out[0] = 0xCB;
+	out[1] = (op & 7) == 6 ? op + 1 : op;
+	return 2;
+}
+
+// Taken and not taken jumps, calls and returns, RSTs
+static int branchMix(uint8_t *out, uint16_t pc)
+{
+	uint32_t r = nextRandom();
+	switch (r % 6) {
+		case 0: // JR cc, +0
+			out[0] = 0x20 + ((r >> 4) % 4) * 8;
+			out[1] = 0x00;
+			return 2;
+		case 1: // JP cc, next
+			out[0] = 0xC2 + ((r >> 4) % 4) * 8;
+			out[1] = (pc + 3) & 0xFF;
+			out[2] = (pc + 3) >> 8;
+			return 3;
+		case 2: // CALL, RET
+			memcpy(out, "\xCD\x80\x00", 3);
+			return 3;
+		case 3: // RST 08, RET
+			out[0] = 0xCF;
+			return 1;
+		default: // vary the flags
+			out[0] = (r >> 4) & 1 ? 0x3C : 0x87;
+			return 1;
+	}
+}
+
+static void runInstructions(uint64_t ops)
+{
+	for (uint64_t i = 0; i < ops; i++) {
+		emu->cpu.executeInstruction();
+	}
+	sink += emu->cpu.r.a;
+}
+
+// Memory accesses spread over a region with a fixed stride
+typedef struct memoryCase_s {
+	const char *name;
+	Memory::MBC mbc;
+	uint16_t base;
+	uint16_t mask;
+	bool write;
+} memoryCase_t;
+
+static const memoryCase_t memoryCases[] = {
+	{"read/ROM0", Memory::MBC::NONE, 0x0000, 0x3FFF, false},
+	{"read/ROMX", Memory::MBC::NONE, 0x4000, 0x3FFF, false},
+	{"read/ROMX/MBC1", Memory::MBC::MBC1, 0x4000, 0x3FFF, false},
+	{"read/ROMX/MBC3", Memory::MBC::MBC3, 0x4000, 0x3FFF, false},
+	{"read/VRAM", Memory::MBC::NONE, 0x8000, 0x1FFF, false},
+	{"read/EXTRAM", Memory::MBC::NONE, 0xA000, 0x1FFF, false},
+	{"read/EXTRAM/MBC1", Memory::MBC::MBC1, 0xA000, 0x1FFF, false},
+	{"read/EXTRAM/MBC2", Memory::MBC::MBC2, 0xA000, 0x01FF, false},
+	{"read/EXTRAM/MBC3", Memory::MBC::MBC3, 0xA000, 0x1FFF, false},
+	{"read/WRAM", Memory::MBC::NONE, 0xC000, 0x1FFF, false},
+	{"read/OAM", Memory::MBC::NONE, 0xFE00, 0x007F, false},
+	{"read/IO", Memory::MBC::NONE, 0xFF00, 0x003F, false},
+	{"read/HRAM", Memory::MBC::NONE, 0xFF80, 0x003F, false},
+	{"write/VRAM", Memory::MBC::NONE, 0x8000, 0x1FFF, true},
+	{"write/EXTRAM/MBC1", Memory::MBC::MBC1, 0xA000, 0x1FFF, true},
+	{"write/WRAM", Memory::MBC::NONE, 0xC000, 0x1FFF, true},
+	{"write/OAM", Memory::MBC::NONE, 0xFE00, 0x007F, true},
+	{"write/HRAM", Memory::MBC::NONE, 0xFF80, 0x003F, true},
+	{"write/bank/MBC1", Memory::MBC::MBC1, 0x2000, 0x1FFF, true},
+	{"write/bank/MBC3", Memory::MBC::MBC3, 0x2000, 0x1FFF, true},
+};
+
+static void runMemory(memoryCase_t const &memoryCase, uint64_t ops)
+{
+	Memory &memory = emu->memory;
+	uint64_t sum = 0;
+	if (memoryCase.write) {
+		for (uint64_t i = 0; i < ops; i++) {
+			memory.writeByte(i % 127 + 1, memoryCase.base + ((i * 97) & memoryCase.mask));
+		}
+	} else {
+		for (uint64_t i = 0; i < ops; i++) {
+			sum += memory.readByte(memoryCase.base + ((i * 97) & memoryCase.mask));
+		}
+	}
+	sink += sum;
+}
+
+// Random tiles and maps, sprites optional
+static void setupGraphics(uint8_t flags, int sprites)
+{
+	seed = BENCH_SEED;
+	loadRom(Memory::MBC::NONE, 0);
+	Memory &memory = emu->memory;
+	for (uint16_t addr = 0x8000; addr < 0xA000; addr++) {
+		memory.writeByte(nextRandom(), addr);
+	}
+	memory.writeByte(0xE4, 0xFF47); // BGP
+	memory.writeByte(0xD2, 0xFF48); // OBP0
+	memory.writeByte(0x1B, 0xFF49); // OBP1
+	memory.writeByte(flags, 0xFF40);
+	memory.writeByte(0, 0xFF4A); // WY
+	memory.writeByte(7, 0xFF4B); // WX
+
+	// All of them on the same 16 lines, each line has to pick 10 of 40
+	for (int i = 0; i < sprites; i++) {
+		memory.writeByte(16 + (i % 4), 0xFE00 + i * 4);
+		memory.writeByte(i * 4, 0xFE01 + i * 4);
+		memory.writeByte(nextRandom(), 0xFE02 + i * 4);
+		memory.writeByte(nextRandom() & 0xF0, 0xFE03 + i * 4);
+	}
+}
+
+static void runScanlines(uint64_t ops, int lines)
+{
+	Graphics &graphics = emu->graphics;
+	for (uint64_t i = 0; i < ops; i++) {
+		graphics.r.line = i % lines;
+		graphics.renderScanline();
+	}
+	sink += graphics.screenPixels[0];
+}
+
+// Writes a whole tile, then draws a line, so the tile is decoded again
+static void runDirtyScanlines(uint64_t ops)
+{
+	Graphics &graphics = emu->graphics;
+	Memory &memory = emu->memory;
+	for (uint64_t i = 0; i < ops; i++) {
+		uint16_t tile = 0x8000 + (i * 16 * 7) % 0x1000;
+		for (int b = 0; b < 16; b++) {
+			memory.writeByte(i + b, tile + b);
+		}
+		graphics.r.line = i % GB_SCREEN_HEIGHT;
+		graphics.renderScanline();
+	}
+	sink += graphics.screenPixels[0];
+}
+
+static void runUpdateTile(uint64_t ops)
+{
+	Graphics &graphics = emu->graphics;
+	for (uint64_t i = 0; i < ops; i++) {
+		graphics.updateTile(i, i % 0x2000);
+	}
+	sink += graphics.tilesDirty[0];
+}
+
+// All four channels playing
+static void setupAudio()
+{
+	loadRom(Memory::MBC::NONE, 0);
+	Memory &memory = emu->memory;
+	static const uint16_t registers[][2] = {
+		{0xFF26, 0x80}, {0xFF24, 0x77}, {0xFF25, 0xFF},
+		{0xFF12, 0xF3}, {0xFF11, 0x80}, {0xFF13, 0x73}, {0xFF14, 0x86},
+		{0xFF17, 0xA7}, {0xFF16, 0x40}, {0xFF18, 0xD6}, {0xFF19, 0x85},
+		{0xFF1A, 0x80}, {0xFF1C, 0x20}, {0xFF1D, 0x0B}, {0xFF1E, 0x87},
+		{0xFF21, 0xF1}, {0xFF22, 0x45}, {0xFF23, 0x80},
+	};
+	for (int i = 0; i < 16; i++) {
+		memory.writeByte(i * 0x11, 0xFF30 + i);
+	}
+	for (auto const &reg : registers) {
+		memory.writeByte(reg[1], reg[0]);
+	}
+}
+
+static size_t drainAudio()
+{
+	int16_t samples[AUDIO_BUFFER_SIZE];
+	return emu->audioBuffer.popMany(samples, AUDIO_BUFFER_SIZE);
+}
+
+static void runAudioFrames(uint64_t ops)
+{
+	for (uint64_t i = 0; i < ops; i++) {
+		emu->cpu.c += CPU_CLOCKS_PER_FRAME;
+		emu->audio.runUntil(emu->cpu.c * 4);
+		emu->audio.flushSamples();
+		sink += drainAudio();
+	}
+}
+
+// The device's starting point: the queue at its target fill
+static void setupPlayAudio()
+{
+	static const int16_t silence[AUDIO_BUFFER_SIZE] = {};
+	drainAudio();
+	emu->audioBuffer.pushMany(silence, emu->audioTarget);
+	emu->audioStarved = false;
+}
+
+// One device callback per op, with the queue kept at its target fill
+static void runPlayAudio(uint64_t ops)
+{
+	static int16_t samples[128];
+	int16_t stream[128];
+	for (uint64_t i = 0; i < ops; i++) {
+		emu->audioBuffer.pushMany(samples, 128);
+		Audio::play_audio(emu, (uint8_t *)stream, sizeof(stream));
+	}
+	sink += stream[0];
+}
+
+// Names built from words, like a disassembled game's
+static std::string writeSymbolFile()
+{
+	static const char *words[] = {"Init", "Update", "Draw", "Sprite", "Player", "Enemy", "Map", "Text",
+		"Sound", "Menu", "Battle", "Load", "Copy", "Fill", "Wait", "VBlank", "Tile", "Palette", "Script", "Item"};
+	const int wordCount = sizeof(words) / sizeof(words[0]);
+
+	std::string filename = (std::filesystem::temp_directory_path() / "dromaius-bench.sym").string();
+	std::ofstream file(filename);
+	seed = BENCH_SEED;
+	for (int i = 0; i < BENCH_SYMBOLS; i++) {
+		uint32_t r = nextRandom();
+		unsigned bank = r % 64;
+		unsigned addr = (bank ? 0x4000 : 0x0000) + (nextRandom() & 0x3FFF);
+		char line[96];
+		snprintf(line, sizeof(line), "%02X:%04X %s%s%s_%d\n", bank, addr, words[(r >> 6) % wordCount],
+			words[(r >> 11) % wordCount], (r >> 16) & 1 ? "." : "", i);
+		file << line;
+	}
+	return filename;
+}
+
+static void setupSymbols()
+{
+	if (emu->symbols.size() == 0) {
+		emu->symbols.load(writeSymbolFile());
+	}
+	seed = BENCH_SEED;
+}
+
+// Symbol addresses half of the time, anywhere in the bank otherwise
+static void randomSymbolAddress(uint8_t &bank, uint16_t &addr)
+{
+	Symbols &symbols = emu->symbols;
+	uint32_t r = nextRandom();
+	Symbols::symbol_t const &symbol = symbols.byName[r % symbols.size()];
+	bank = symbol.bank;
+	addr = r & 1 ? symbol.addr : (bank ? 0x4000 : 0x0000) + (nextRandom() & 0x3FFF);
+}
+
+static void runSymbolNames(uint64_t ops)
+{
+	for (uint64_t i = 0; i < ops; i++) {
+		uint8_t bank;
+		uint16_t addr;
+		randomSymbolAddress(bank, addr);
+		sink += emu->symbols.name(bank, addr).size();
+	}
+}
+
+static void runSymbolFormat(uint64_t ops)
+{
+	char buf[64];
+	for (uint64_t i = 0; i < ops; i++) {
+		uint8_t bank;
+		uint16_t addr;
+		randomSymbolAddress(bank, addr);
+		sink += emu->symbols.format(buf, sizeof(buf), bank, addr);
+	}
+}
+
+static void runSymbolFind(uint64_t ops)
+{
+	Symbols &symbols = emu->symbols;
+	for (uint64_t i = 0; i < ops; i++) {
+		sink += symbols.find(symbols.byAddr[0][nextRandom() % symbols.byAddr[0].size()].name) != nullptr;
+	}
+}
+
+static void runSymbolSearch(uint64_t ops)
+{
+	static const char *queries[] = {"vb", "pl", "drawsprite", "playr", "enemyupd", "ldmap", "palette_1", "txt"};
+	uint32_t results[GUI_SEARCH_RESULTS];
+	for (uint64_t i = 0; i < ops; i++) {
+		sink += emu->symbols.search(queries[i % 8], results, GUI_SEARCH_RESULTS);
+	}
+}
+
+static void runInstructionToString(uint64_t ops)
+{
+	uint8_t *rom = emu->memory.rom;
+	char text[64];
+	uint16_t pc = 0;
+	for (uint64_t i = 0; i < ops; i++) {
+		pc = CPU::instructionToString(rom + pc, pc, text) & 0x3FFF;
+		sink += text[0];
+	}
+}
+
+static std::vector<bench_t> benchmarks()
+{
+	std::vector<bench_t> list;
+
+	list.push_back({"cpu/executeInstruction/alu", [] { loadMix(aluMix); }, runInstructions});
+	list.push_back({"cpu/executeInstruction/load-store", [] { loadMix(loadStoreMix); }, runInstructions});
+	list.push_back({"cpu/executeInstruction/cb", [] { loadMix(cbMix); }, runInstructions});
+	list.push_back({"cpu/executeInstruction/branch", [] { loadMix(branchMix); }, runInstructions});
+	list.push_back({"cpu/instructionToString", [] { seed = BENCH_SEED; loadRom(Memory::MBC::NONE, 0); },
+		runInstructionToString});
+
+	for (memoryCase_t const &memoryCase : memoryCases) {
+		list.push_back({std::string("memory/") + memoryCase.name,
+			[&memoryCase] { seed = BENCH_SEED; loadRom(memoryCase.mbc, 3); },
+			[&memoryCase](uint64_t ops) { runMemory(memoryCase, ops); }});
+	}
+
+	const uint8_t lcd = Graphics::LCD | Graphics::BG | Graphics::TILESET;
+	list.push_back({"graphics/renderScanline/bg", [=] { setupGraphics(lcd, 0); },
+		[](uint64_t ops) { runScanlines(ops, GB_SCREEN_HEIGHT); }});
+	list.push_back({"graphics/renderScanline/window", [=] { setupGraphics(lcd | Graphics::WINDOW, 0); },
+		[](uint64_t ops) { runScanlines(ops, GB_SCREEN_HEIGHT); }});
+	list.push_back({"graphics/renderScanline/sprites", [=] { setupGraphics(lcd | Graphics::SPRITES | Graphics::SPRITESIZE, 40); },
+		[](uint64_t ops) { runScanlines(ops, 16); }});
+	list.push_back({"graphics/renderScanline/dirty-tile", [=] { setupGraphics(lcd, 0); }, runDirtyScanlines});
+	list.push_back({"graphics/updateTile", [=] { setupGraphics(lcd, 0); }, runUpdateTile});
+
+	list.push_back({"audio/frame", setupAudio, runAudioFrames});
+	list.push_back({"audio/play_audio", setupPlayAudio, runPlayAudio});
+
+	list.push_back({"symbols/name", setupSymbols, runSymbolNames});
+	list.push_back({"symbols/format", setupSymbols, runSymbolFormat});
+	list.push_back({"symbols/find", setupSymbols, runSymbolFind});
+	list.push_back({"symbols/search", setupSymbols, runSymbolSearch});
+
+	return list;
+}
+
+static double timeRun(bench_t const &bench, uint64_t ops)
+{
+	auto start = std::chrono::steady_clock::now();
+	bench.run(ops);
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static result_t measure(bench_t const &bench, int reps, double minTimeNs)
+{
+	bench.setup();
+
+	// Double the ops until a repetition takes long enough, this also warms up
+	uint64_t ops = 1;
+	double ns;
+	while ((ns = timeRun(bench, ops)) < minTimeNs) {
+		ops = ns < minTimeNs / 16 ? ops * 8 : ops * 2;
+	}
+
+	std::vector<double> samples;
+	for (int i = 0; i < reps; i++) {
+		samples.push_back(timeRun(bench, ops) / ops);
+	}
+	std::sort(samples.begin(), samples.end());
+	double median = samples[samples.size() / 2];
+
+	std::vector<double> deviations;
+	for (double sample : samples) {
+		deviations.push_back(std::abs(sample - median));
+	}
+	std::sort(deviations.begin(), deviations.end());
+
+	return {bench.name, ops, median, samples[0], 100.0 * deviations[deviations.size() / 2] / median};
+}
+
+static bool writeJson(std::string const &filename, std::vector<result_t> const &results, int reps)
+{
+	FILE *file = fopen(filename.c_str(), "w");
+	if (not file) {
+		printf("Can't write '%s'\n", filename.c_str());
+		return false;
+	}
+
+#ifdef GRAPHICS_SIMD_RENDERER
+	const bool simd = true;
+#else
+	const bool simd = false;
+#endif
+	fprintf(file, "{\n  \"reps\": %d,\n  \"simd\": %s,\n  \"benchmarks\": [\n", reps, simd ? "true" : "false");
+	for (size_t i = 0; i < results.size(); i++) {
+		result_t const &result = results[i];
+		fprintf(file, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, "
+			"\"deviation_percent\": %.2f, \"ops_per_rep\": %llu}%s\n",
+			result.name.c_str(), result.median, result.min, result.deviation,
+			(unsigned long long)result.ops, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+	return true;
+}
+
+#ifdef GRAPHICS_SIMD_RENDERER
+// Random tiles, maps, sprites and LCD registers, with the window and
+// sprites often on screen
+static void randomizeGraphics()
+{
+	Memory &memory = emu->memory;
+	for (uint16_t addr = 0x8000; addr < 0xA000; addr++) {
+		memory.writeByte(nextRandom(), addr);
+	}
+	for (uint16_t addr = 0xFE00; addr < 0xFEA0; addr += 4) {
+		memory.writeByte(nextRandom() % 176, addr); // y
+		memory.writeByte(nextRandom() % 176, addr + 1); // x
+		memory.writeByte(nextRandom(), addr + 2);
+		memory.writeByte(nextRandom(), addr + 3);
+	}
+
+	memory.writeByte(nextRandom() | Graphics::LCD, 0xFF40);
+	memory.writeByte(nextRandom(), 0xFF42); // SCY
+	memory.writeByte(nextRandom(), 0xFF43); // SCX
+	memory.writeByte(nextRandom(), 0xFF47); // BGP
+	memory.writeByte(nextRandom(), 0xFF48); // OBP0
+	memory.writeByte(nextRandom(), 0xFF49); // OBP1
+	memory.writeByte(nextRandom() % 160, 0xFF4A); // WY
+	memory.writeByte(nextRandom() % 176, 0xFF4B); // WX
+}
+
+// Draws every line of seeded states with both renderers, returns the
+// number of lines that differ
+static int verifyRenderers()
+{
+	Graphics &graphics = emu->graphics;
+	uint8_t expected[GB_SCREEN_WIDTH];
+	int mismatches = 0;
+
+	for (int state = 0; state < BENCH_VERIFY_STATES; state++) {
+		seed = BENCH_SEED + state;
+		randomizeGraphics();
+
+		for (int line = 0; line < GB_SCREEN_HEIGHT; line++) {
+			uint8_t *pixels = &graphics.screenPixels[line * GB_SCREEN_WIDTH];
+			graphics.r.line = line;
+
+			// Pixels left alone would show up as 0xFF
+			memset(pixels, 0xFF, GB_SCREEN_WIDTH);
+			graphics.renderScanlinePixels();
+			memcpy(expected, pixels, GB_SCREEN_WIDTH);
+			memset(pixels, 0xFF, GB_SCREEN_WIDTH);
+			graphics.renderScanlineSpans();
+
+			if (memcmp(expected, pixels, GB_SCREEN_WIDTH) == 0) {
+				continue;
+			}
+			if (mismatches++ < BENCH_VERIFY_SHOWN) {
+				int x = std::mismatch(expected, expected + GB_SCREEN_WIDTH, pixels).first - expected;
+				printf("state %d line %d x %d: pixels %02X, spans %02X"
+					" (LCDC %02X SCX %02X SCY %02X WX %02X WY %02X)\n",
+					state, line, x, expected[x], pixels[x], graphics.r.flags,
+					graphics.r.scx, graphics.r.scy, graphics.r.winx, graphics.r.winy);
+			}
+		}
+	}
+
+	printf("%d states, %d lines, %d differ\n", BENCH_VERIFY_STATES,
+		BENCH_VERIFY_STATES * GB_SCREEN_HEIGHT, mismatches);
+	return mismatches;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	std::string filter, json;
+	int reps = BENCH_REPS;
+	double minTimeMs = BENCH_MIN_TIME_MS;
+	bool list = false;
+	bool verify = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--filter" and hasValue) {
+			filter = argv[++i];
+		} else if (arg == "--reps" and hasValue) {
+			reps = std::max(atoi(argv[++i]), 1);
+		} else if (arg == "--min-time" and hasValue) {
+			minTimeMs = atof(argv[++i]);
+		} else if (arg == "--json" and hasValue) {
+			json = argv[++i];
+		} else if (arg == "--list") {
+			list = true;
+		} else if (arg == "--verify-renderers") {
+			verify = true;
+		} else {
+			printf("Usage: %s [--filter text] [--reps n] [--min-time ms] [--json file] [--list]\n", argv[0]);
+			printf("       %s --verify-renderers\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// No sound card needed, and the device mustn't compete for the queue
+	setenv("SDL_AUDIODRIVER", "dummy", 0);
+
+	settings_t settings = {};
+	settings.audioQuality = Resampler::NORMAL;
+	settings.audioLatency = 40;
+	settings.logLevel = Logger::LEVEL_COUNT; // nothing
+	static Dromaius instance(settings);
+	emu = &instance;
+
+	loadRom(Memory::MBC::NONE, 0);
+	SDL_PauseAudioDevice(emu->audio.dev, 1);
+
+	if (verify) {
+#ifdef GRAPHICS_SIMD_RENDERER
+		return verifyRenderers() ? 1 : 0;
+#else
+		printf("Only a SIMD=1 build has the span renderer to verify\n");
+		return 1;
+#endif
+	}
+
+	if (not emu->audio.dev) {
+		printf("No audio device, audio/frame runs without resampling\n");
+	}
+
+	std::vector<result_t> results;
+	for (bench_t const &bench : benchmarks()) {
+		if (bench.name.find(filter) == std::string::npos) {
+			continue;
+		}
+		if (list) {
+			printf("%s\n", bench.name.c_str());
+			continue;
+		}
+
+		result_t result = measure(bench, reps, minTimeMs * 1e6);
+		printf("%-40s %12.2f ns/op  min %12.2f  +-%5.1f%%%s\n", result.name.c_str(),
+			result.median, result.min, result.deviation, result.deviation > BENCH_NOISY ? "  noisy" : "");
+		fflush(stdout);
+		results.push_back(result);
+	}
+
+	if (not json.empty() and not writeJson(json, results, reps)) {
+		return 1;
+	}
+	return 0;
+}
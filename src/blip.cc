@@ -0,0 +1,98 @@
+#include <cstring>
+#include <cmath>
+#include "blip.h"
+
+// Windowed sinc impulses, one per sub-sample phase, each summing to 1.
+// Integrated while reading, they turn a delta into a band-limited step.
+alignas(16) static float blipKernel[BLIP_PHASES][BLIP_WIDTH];
+
+static void initKernel()
+{
+	static bool done = false;
+	if (done) {
+		return;
+	}
+
+	const double cutoff = 0.9; // of Nyquist, leaves some room for the window
+
+	for (int p = 0; p < BLIP_PHASES; p++) {
+		double sum = 0;
+		for (int i = 0; i < BLIP_WIDTH; i++) {
+			// Distance from the step's position, centered in the kernel
+			double x = i - (BLIP_WIDTH / 2 - 1) - (double)p / BLIP_PHASES;
+			double sinc = x == 0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+
+			// Blackman window over the kernel width
+			double w = (x + BLIP_WIDTH / 2.0) / BLIP_WIDTH;
+			double window = 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+
+			blipKernel[p][i] = sinc * window;
+			sum += blipKernel[p][i];
+		}
+		for (int i = 0; i < BLIP_WIDTH; i++) {
+			blipKernel[p][i] /= sum;
+		}
+	}
+
+	done = true;
+}
+
+void BlipBuffer::initialize(uint32_t clockRate, uint32_t sampleRate, uint64_t time)
+{
+	initKernel();
+
+	this->clockRate = clockRate;
+	this->sampleRate = sampleRate;
+	start = time * sampleRate;
+	integrator = 0;
+	used = 0;
+	memset(deltas, 0, sizeof(deltas));
+}
+
+void BlipBuffer::addDelta(uint64_t time, float delta)
+{
+	uint64_t pos = time * sampleRate - start;
+	size_t index = pos / clockRate;
+	size_t phase = (pos % clockRate) * BLIP_PHASES / clockRate;
+
+	if (index >= BLIP_BUFFER_SIZE) {
+		return; // not read out in time
+	}
+
+	float *d = &deltas[index];
+	const float *k = blipKernel[phase];
+	for (int i = 0; i < BLIP_WIDTH; i++) {
+		d[i] += delta * k[i];
+	}
+
+	if (index + BLIP_WIDTH > used) {
+		used = index + BLIP_WIDTH;
+	}
+}
+
+size_t BlipBuffer::samplesAvailable(uint64_t time) const
+{
+	size_t available = (time * sampleRate - start) / clockRate;
+	return available < BLIP_BUFFER_SIZE ? available : BLIP_BUFFER_SIZE;
+}
+
+size_t BlipBuffer::readSamples(float *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		integrator += deltas[i];
+		out[i] = integrator;
+	}
+
+	// Keep the kernel tails that reach past what was read
+	if (used > count) {
+		memmove(deltas, deltas + count, (used - count) * sizeof(float));
+		memset(deltas + used - count, 0, count * sizeof(float));
+		used -= count;
+	} else {
+		memset(deltas, 0, used * sizeof(float));
+		used = 0;
+	}
+	start += (uint64_t)count * clockRate;
+
+	return count;
+}
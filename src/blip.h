@@ -0,0 +1,34 @@
+#ifndef INCLUDED_BLIP_H
+#define INCLUDED_BLIP_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define BLIP_PHASES      32   // sub-sample positions of the step kernel
+#define BLIP_WIDTH       16   // kernel taps, a multiple of 4 for SIMD
+#define BLIP_BUFFER_SIZE 4096 // samples that can be pending
+
+// Band-limited synthesis: amplitude changes are added as deltas at exact
+// clock times, each spread over BLIP_WIDTH samples with a precomputed
+// band-limited step kernel. Reading integrates the deltas, so every output
+// sample costs one add, and transitions cost BLIP_WIDTH multiply-adds.
+// Plain arrays only, so it can be part of a savestate.
+struct BlipBuffer
+{
+	uint32_t clockRate;
+	uint32_t sampleRate;
+	uint64_t start; // clock time of deltas[0], times sampleRate
+	float integrator;
+	uint32_t used; // deltas beyond this are all zero
+	alignas(16) float deltas[BLIP_BUFFER_SIZE + BLIP_WIDTH];
+
+	void initialize(uint32_t clockRate, uint32_t sampleRate, uint64_t time);
+
+	void addDelta(uint64_t time, float delta);
+
+	// Samples before this clock time can't change anymore
+	size_t samplesAvailable(uint64_t time) const;
+	size_t readSamples(float *out, size_t count);
+};
+
+#endif
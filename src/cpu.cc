@@ -17,7 +17,6 @@ void CPU::initialize()
 	
 	// Jump over bios
 	r.pc = 0x0100;
-	callStackPush(0x0000, r.pc);
 	
 	intsOn = false;//1;
 	intFlags = 0;
@@ -508,7 +507,7 @@ void CPU::doCpRegA(uint8_t val)
 
 void CPU::doOpcodeUNIMP()
 {
-	printf("Unimplemented instruction (0x%02X) at 0x%04X.\n", emu->memory.readByte(r.pc-1), r.pc-1);
+	LOG(emu, ERROR, "Unimplemented instruction (0x%02X) at 0x%04X.", emu->memory.readByte(r.pc-1), r.pc-1);
 	//exit(1);
 }
 
@@ -780,30 +779,6 @@ void CPU::handleTimers()
 	}
 }
 
-void CPU::callStackPush(uint16_t oldpc, uint16_t pc)
-{
-	//for(int i = 0; i < callStackDepth+1; ++i) printf("--");
-	//printf("push: %04X -> %04X\n", oldpc, pc);
-	// Just wrap if the callstack becomes really high..
-	if (callStackDepth == CPU_CALL_STACK_SIZE - 1) {
-		callStackDepth = 0;
-		printf("callstack overflow\n");
-	}
-	callStack[callStackDepth++] = pc;
-}
-
-void CPU::callStackPop(uint16_t oldpc, uint16_t pc)
-{
-	//for(int i = 0; i < callStackDepth; ++i) printf("--");
-	//printf("pop: %04X -> %04X\n", oldpc, pc);
-	callStackDepth--;
-
-	if (callStackDepth < 0) {
-		callStackDepth = 0;
-		//printf("callstack underflow\n");
-	}
-}
-
 void CPU::handleInterrupts()
 {
 	// Interrupts
@@ -818,6 +793,7 @@ void CPU::handleInterrupts()
 		//}
 		
 		// Push PC;
+		uint16_t site = r.pc;
 		r.sp -= 2;
 		emu->memory.writeWord(r.pc, r.sp);
 
@@ -830,7 +806,7 @@ void CPU::handleInterrupts()
 			r.pc = 0x48;
 		}
 		else if (interrupts & Int::TIMER) {
-			printf("timer interrupt!\n");
+			LOG(emu, DEBUG, "timer interrupt!");
 			intFlags &= ~Int::TIMER;
 			r.pc = 0x50;
 		}
@@ -842,6 +818,7 @@ void CPU::handleInterrupts()
 			intFlags &= ~Int::JOYPAD;
 			r.pc = 0x60;
 		}	
+		emu->profiler.call(site, r.pc, r.sp, Profiler::INTERRUPT);
 
 		c += 8;
 	}
@@ -866,9 +843,9 @@ int CPU::executeInstruction()
 		// printRegisters();
 
 		// Print trace of executed symbols
-		std::string symbol = emu->memory.getSymbolFromAddress(emu->memory.romBank, r.pc);
+		std::string_view symbol = emu->symbols.name(emu->symbols.currentBank(r.pc), r.pc);
 		if (not symbol.empty()) {
-			printf("hit symbol: %s\n", symbol.c_str());
+			printf("hit symbol: %.*s\n", (int)symbol.size(), symbol.data());
 		}
 	}
 
@@ -1000,7 +977,7 @@ int CPU::executeInstruction()
 				
 			case 0x10: // STOP
 				// TODO: Implement this
-				printf("STOP instruction\n");
+				LOG(emu, INFO, "STOP instruction");
 				timer.div = 0; // STOP resets the timer
 				c += 1;
 				break;
@@ -2003,9 +1980,8 @@ int CPU::executeInstruction()
 
 			case 0xC0: // RET NZ
 				if (not getFlag(Flag::ZERO)) {
-					oldpc = r.pc;
+					emu->profiler.ret(r.sp);
 					r.pc = emu->memory.readWord(r.sp);
-					callStackPop(oldpc, r.pc);
 					r.sp += 2;
 					c += 3;
 				}
@@ -2041,7 +2017,7 @@ int CPU::executeInstruction()
 					emu->memory.writeWord(r.pc + 2, r.sp);
 					oldpc = r.pc;
 					r.pc = emu->memory.readWord(r.pc);
-					callStackPush(oldpc, r.pc);
+					emu->profiler.call(oldpc - 1, r.pc, r.sp, Profiler::CALL);
 					c += 3;
 				} else {
 					r.pc += 2;
@@ -2067,15 +2043,15 @@ int CPU::executeInstruction()
 			case 0xC7: // RST 00
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x00, r.sp, Profiler::RST);
 				r.pc = 0x00;
 				c += 4;
 				break;
 
 			case 0xC8: // RET Z
 				if (getFlag(Flag::ZERO)) {
-					oldpc = r.pc;
+					emu->profiler.ret(r.sp);
 					r.pc = emu->memory.readWord(r.sp);
-					callStackPop(oldpc, r.pc);
 					r.sp += 2;
 					c += 3;
 				}
@@ -2083,9 +2059,8 @@ int CPU::executeInstruction()
 				break;
 
 			case 0xC9: // RET
-				oldpc = r.pc;
+				emu->profiler.ret(r.sp);
 				r.pc = emu->memory.readWord(r.sp);
-				callStackPop(oldpc, r.pc);
 				r.sp += 2;
 				c += 4;
 				break;
@@ -2112,7 +2087,7 @@ int CPU::executeInstruction()
 					emu->memory.writeWord(r.pc + 2, r.sp);
 					oldpc = r.pc;
 					r.pc = emu->memory.readWord(r.pc);
-					callStackPush(oldpc, r.pc);
+					emu->profiler.call(oldpc - 1, r.pc, r.sp, Profiler::CALL);
 					c += 3;
 				} else {
 					r.pc += 2;
@@ -2125,7 +2100,7 @@ int CPU::executeInstruction()
 				emu->memory.writeWord(r.pc + 2, r.sp);
 				oldpc = r.pc;
 				r.pc = emu->memory.readWord(r.pc);
-				callStackPush(oldpc, r.pc);
+				emu->profiler.call(oldpc - 1, r.pc, r.sp, Profiler::CALL);
 				c += 6;
 				break;
 
@@ -2138,15 +2113,15 @@ int CPU::executeInstruction()
 			case 0xCF: // RST 08
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x08, r.sp, Profiler::RST);
 				r.pc = 0x08;
 				c += 4;
 				break;
 
 			case 0xD0: // RET NC
 				if (not getFlag(Flag::CARRY)) {
-					oldpc = r.pc;
+					emu->profiler.ret(r.sp);
 					r.pc = emu->memory.readWord(r.sp);
-					callStackPop(oldpc, r.pc);
 					r.sp += 2;
 					c += 3;
 				}
@@ -2181,7 +2156,7 @@ int CPU::executeInstruction()
 					emu->memory.writeWord(r.pc + 2, r.sp);
 					oldpc = r.pc;
 					r.pc = emu->memory.readWord(r.pc);
-					callStackPush(oldpc, r.pc);
+					emu->profiler.call(oldpc - 1, r.pc, r.sp, Profiler::CALL);
 					c += 3;
 				} else {
 					r.pc += 2;
@@ -2206,15 +2181,15 @@ int CPU::executeInstruction()
 			case 0xD7: // RST 10
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x10, r.sp, Profiler::RST);
 				r.pc = 0x10;
 				c += 4;
 				break;
 
 			case 0xD8: // RET C
 				if (getFlag(Flag::CARRY)) {
-					oldpc = r.pc;
+					emu->profiler.ret(r.sp);
 					r.pc = emu->memory.readWord(r.sp);
-					callStackPop(oldpc, r.pc);
 					r.sp += 2;
 					c += 3;
 				}
@@ -2225,6 +2200,7 @@ int CPU::executeInstruction()
 				intsOn = true;
 				//printf("reti, intsOn = 1\n");
 				
+				emu->profiler.ret(r.sp);
 				r.pc = emu->memory.readWord(r.sp);
 				r.sp += 2;
 				
@@ -2251,7 +2227,7 @@ int CPU::executeInstruction()
 					emu->memory.writeWord(r.pc + 2, r.sp);
 					oldpc = r.pc;
 					r.pc = emu->memory.readWord(r.pc);
-					callStackPush(oldpc, r.pc);
+					emu->profiler.call(oldpc - 1, r.pc, r.sp, Profiler::CALL);
 					c += 3;
 				} else {
 					r.pc += 2;
@@ -2272,6 +2248,7 @@ int CPU::executeInstruction()
 			case 0xDF: // RST 18
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x18, r.sp, Profiler::RST);
 				r.pc = 0x18;
 				c += 4;
 				break;
@@ -2317,6 +2294,7 @@ int CPU::executeInstruction()
 			case 0xE7: // RST 20
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x20, r.sp, Profiler::RST);
 				r.pc = 0x20;
 				c += 4;
 				break;
@@ -2371,6 +2349,7 @@ int CPU::executeInstruction()
 			case 0xEF: // RST 28
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x28, r.sp, Profiler::RST);
 				r.pc = 0x28;
 				c += 4;
 				break;
@@ -2421,6 +2400,7 @@ int CPU::executeInstruction()
 			case 0xF7: // RST 30
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x30, r.sp, Profiler::RST);
 				r.pc = 0x30;
 				c += 4;
 				break;
@@ -2482,12 +2462,13 @@ int CPU::executeInstruction()
 			case 0xFF: // RST 38
 				r.sp -= 2;
 				emu->memory.writeWord(r.pc, r.sp);
+				emu->profiler.call(r.pc - 1, 0x38, r.sp, Profiler::RST);
 				r.pc = 0x38;
 				c += 4;
 				break;
 				
 			default:
-				printf("There's a glitch in the matrix, this shouldn't happen.\n");
+				LOG(emu, ERROR, "There's a glitch in the matrix, this shouldn't happen.");
 				return 0;
 		}
 	} else {
@@ -2513,7 +2494,7 @@ int CPU::executeInstruction()
 	return 1;
 }
 
-inline const char *CPU::numToRegName(uint8_t num)
+const char *CPU::numToRegName(uint8_t num)
 {
 	switch (num % 8) {
 		case 0: return "B";
@@ -2529,9 +2510,19 @@ inline const char *CPU::numToRegName(uint8_t num)
 }
 
 
+// Disassemble the instruction at pc, as mapped in right now
 uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 {
-	uint8_t inst = emu->memory.readByte(pc);
+	uint8_t bytes[3];
+	emu->memory.peekRange(pc, sizeof(bytes), MEMORY_BANK_CURRENT, bytes);
+	return instructionToString(bytes, pc, instStr);
+}
+
+// Disassemble from a copy of the instruction's bytes, so it also works
+// on banks that aren't mapped in. Returns the address after it.
+uint16_t CPU::instructionToString(const uint8_t *bytes, uint16_t pc, char *instStr)
+{
+	uint8_t inst = bytes[0];
 	uint16_t npc = pc + 1;
 	uint8_t extraOp, bitnr;
 
@@ -2541,9 +2532,9 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x01: // LD BC, nn
-			sprintf(instStr, "LD BC, 0x%04X", emu->memory.readWord(npc));
-			break;
+			sprintf(instStr, "LD BC, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
+			break;
 			
 		case 0x02: // LD (BC), A
 			sprintf(instStr, "LD (BC), A");
@@ -2562,7 +2553,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x06: // LD B, n
-			sprintf(instStr, "LD B, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD B, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2571,7 +2562,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x08: // LD (nn), SP
-			sprintf(instStr, "LD (0x%04X), SP", emu->memory.readWord(npc));
+			sprintf(instStr, "LD (0x%04X), SP", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 			
@@ -2596,7 +2587,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x0E: // LD C, n
-			sprintf(instStr, "LD C, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD C, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2609,7 +2600,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x11: // LD DE, nn
-			sprintf(instStr, "LD DE, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "LD DE, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 		
@@ -2630,7 +2621,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x16: // LD D, n
-			sprintf(instStr, "LD D, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD D, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2639,7 +2630,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 		
 		case 0x18: // JR n
-			sprintf(instStr, "JR 0x%02X (%d)", emu->memory.readByte(npc), (int8_t)emu->memory.readByte(npc));
+			sprintf(instStr, "JR 0x%02X (%d)", bytes[1], (int8_t)bytes[1]);
 			npc++;
 			break;
 			
@@ -2664,7 +2655,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x1E: // LD E, n
-			sprintf(instStr, "LD E, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD E, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2673,12 +2664,12 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x20: // JR NZ, n
-			sprintf(instStr, "JR NZ, 0x%02X (%d)", emu->memory.readByte(npc), (int8_t)emu->memory.readByte(npc));
+			sprintf(instStr, "JR NZ, 0x%02X (%d)", bytes[1], (int8_t)bytes[1]);
 			npc++;
 			break;
 			
 		case 0x21: // LD HL, nn
-			sprintf(instStr, "LD HL, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "LD HL, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 			
@@ -2699,7 +2690,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x26: // LD H, n
-			sprintf(instStr, "LD H, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD H, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2708,7 +2699,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x28: // JR Z, n
-			sprintf(instStr, "JR Z, 0x%02X (%d)", emu->memory.readByte(npc), (int8_t)emu->memory.readByte(npc));
+			sprintf(instStr, "JR Z, 0x%02X (%d)", bytes[1], (int8_t)bytes[1]);
 			npc++;
 			break;
 			
@@ -2733,7 +2724,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x2E: // LD L, n
-			sprintf(instStr, "LD L, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD L, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2742,12 +2733,12 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x30: // JR NC, n
-			sprintf(instStr, "JR NC, 0x%02X (%d)", emu->memory.readByte(npc), (int8_t)emu->memory.readByte(npc));
+			sprintf(instStr, "JR NC, 0x%02X (%d)", bytes[1], (int8_t)bytes[1]);
 			npc++;
 			break;
 			
 		case 0x31: // LD SP, nn
-			sprintf(instStr, "LD SP, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "LD SP, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 			
@@ -2768,7 +2759,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x36: // LD (HL), n
-			sprintf(instStr, "LD (HL), 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD (HL), 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -2777,7 +2768,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x38: // JR C, n
-			sprintf(instStr, "JR C, 0x%02X (%d)", emu->memory.readByte(npc), (int8_t)emu->memory.readByte(npc));
+			sprintf(instStr, "JR C, 0x%02X (%d)", bytes[1], (int8_t)bytes[1]);
 			npc++;
 			break;
 			
@@ -2802,7 +2793,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 			
 		case 0x3E: // LD A, n
-			sprintf(instStr, "LD A, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD A, 0x%02X", bytes[1]);
 			npc++;
 			break;
 			
@@ -3331,16 +3322,17 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xC2: // JP NZ, nn
-			sprintf(instStr, "JP NZ, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "JP NZ, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
 		case 0xC3: // JP nn
-			sprintf(instStr, "JP 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "JP 0x%04X", (bytes[1] | bytes[2] << 8));
+			npc += 2;
 			break;
 
 		case 0xC4: // CALL NZ, nn
-			sprintf(instStr, "CALL NZ, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "CALL NZ, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3349,7 +3341,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xC6: // ADD A, n
-			sprintf(instStr, "ADD A, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "ADD A, 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3366,12 +3358,12 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xCA: // JP Z, nn
-			sprintf(instStr, "JP Z, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "JP Z, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
 		case 0xCB: // Extra instructions
-			extraOp = emu->memory.readWord(npc);
+			extraOp = bytes[1];
 			npc++;
 			// RLC
 			if (extraOp <= 0x07) {
@@ -3423,17 +3415,17 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xCC: // CALL Z, nn
-			sprintf(instStr, "CALL Z, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "CALL Z, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
 		case 0xCD: // CALL nn
-			sprintf(instStr, "CALL 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "CALL 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
 		case 0xCE: // ADC A, n
-			sprintf(instStr, "ADC A, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "ADC A, 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3450,7 +3442,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xD2: // JP NC, nn
-			sprintf(instStr, "JP NC, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "JP NC, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3459,7 +3451,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xD4: // CALL NC, nn
-			sprintf(instStr, "CALL NC, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "CALL NC, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3468,7 +3460,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xD6: // SUB A, n
-			sprintf(instStr, "SUB A, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "SUB A, 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3485,7 +3477,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xDA: // JP C, nn
-			sprintf(instStr, "JP C, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "JP C, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3494,7 +3486,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xDC: // CALL C, nn
-			sprintf(instStr, "CALL C, 0x%04X", emu->memory.readWord(npc));
+			sprintf(instStr, "CALL C, 0x%04X", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3503,7 +3495,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xDE: // SBC A, n
-			sprintf(instStr, "SBC A, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "SBC A, 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3512,7 +3504,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xE0: // LDH (n), A
-			sprintf(instStr, "LD (0xFF%02X), A", emu->memory.readByte(npc));
+			sprintf(instStr, "LD (0xFF%02X), A", bytes[1]);
 			npc++;
 			break;
 
@@ -3534,7 +3526,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xE6: // AND n
-			sprintf(instStr, "AND 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "AND 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3543,7 +3535,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xE8: // ADD SP, n
-			sprintf(instStr, "ADD SP, 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "ADD SP, 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3552,7 +3544,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xEA: // LD (nn), A
-			sprintf(instStr, "LD (0x%04X), A", emu->memory.readWord(npc));
+			sprintf(instStr, "LD (0x%04X), A", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3563,7 +3555,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xEE: // XOR n
-			sprintf(instStr, "XOR 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "XOR 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3572,7 +3564,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xF0: // LDH A, (n)
-			sprintf(instStr, "LDH A, (0x%02X)", emu->memory.readByte(npc));
+			sprintf(instStr, "LDH A, (0x%02X)", bytes[1]);
 			npc++;
 			break;
 
@@ -3597,7 +3589,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xF6: // OR n
-			sprintf(instStr, "OR 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "OR 0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3606,7 +3598,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xF8: // LDHL SP, d
-			sprintf(instStr, "LD HL, SP+0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "LD HL, SP+0x%02X", bytes[1]);
 			npc++;
 			break;
 
@@ -3615,7 +3607,7 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xFA: // LD A, (nn)
-			sprintf(instStr, "LD A, (0x%04X)", emu->memory.readWord(npc));
+			sprintf(instStr, "LD A, (0x%04X)", (bytes[1] | bytes[2] << 8));
 			npc += 2;
 			break;
 
@@ -3629,12 +3621,11 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 			break;
 
 		case 0xFE: // CP n
-			sprintf(instStr, "CP 0x%02X", emu->memory.readByte(npc));
+			sprintf(instStr, "CP 0x%02X", bytes[1]);
 			npc++;
 			break;
 
 		case 0xFF: // RST 38
-			npc = 0x38;
 			sprintf(instStr, "RST 38");
 			break;
 	}
@@ -3642,6 +3633,22 @@ uint16_t CPU::instructionToString(uint16_t pc, char *instStr)
 	return npc;
 }
 
+// Where a jump, call or RST goes, -1 for other instructions
+int CPU::instructionTarget(const uint8_t *bytes, uint16_t pc)
+{
+	switch (bytes[0]) {
+		case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP
+		case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+			return bytes[1] | (bytes[2] << 8);
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+			return (uint16_t)(pc + 2 + (int8_t)bytes[1]);
+		case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+			return bytes[0] - 0xC7;
+		default:
+			return -1;
+	}
+}
+
 void CPU::disassemble(uint16_t pc, size_t instCnt, char *buf) {
 	// TODO: Assumes max inst str len is 25
 	char instBuf[25];
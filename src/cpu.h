@@ -4,8 +4,6 @@
 #include <cstdint>
 struct Dromaius;
 
-#define CPU_CALL_STACK_SIZE 0x100
-
 /*
 
 GB CPU freq:                 4194304 Hz
@@ -73,10 +71,6 @@ struct CPU
 	bool stepInst;
 	bool stepFrame;
 
-	// Debugging
-	uint16_t callStack[CPU_CALL_STACK_SIZE];
-	int callStackDepth;
-
 	// Cycle count
 	unsigned long long c;
 	unsigned long long dc;
@@ -115,12 +109,11 @@ struct CPU
 	void handleTimers();
 	void handleInterrupts();
 	int executeInstruction();
-	inline const char *numToRegName(uint8_t num);
+	static const char *numToRegName(uint8_t num);
 	uint16_t instructionToString(uint16_t pc, char *instStr);
+	static uint16_t instructionToString(const uint8_t *bytes, uint16_t pc, char *instStr);
+	static int instructionTarget(const uint8_t *bytes, uint16_t pc);
 	void disassemble(uint16_t pc, size_t instCnt, char *buf);
-
-	void callStackPush(uint16_t oldpc, uint16_t pc);
-	void callStackPop(uint16_t oldpc, uint16_t pc);
 };
 
 #endif
\ No newline at end of file
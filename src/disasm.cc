@@ -0,0 +1,269 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "dromaius.h"
+
+Disassembly::~Disassembly()
+{
+	stop();
+}
+
+void Disassembly::stop()
+{
+	if (builder.joinable()) {
+		cancel = true;
+		builder.join();
+	}
+}
+
+void Disassembly::initialize()
+{
+	initSegment(ram[WRAM], "WRAM", 0xC000, 0x2000, 0);
+	initSegment(ram[HRAM], "HRAM", 0xFF80, 0x7F, 0);
+	memset(ramStale, 0, sizeof(ramStale));
+	invalidateRam();
+}
+
+void Disassembly::initSegment(segment_t &seg, const char *name, uint16_t start, uint32_t size, uint8_t bank)
+{
+	snprintf(seg.name, sizeof(seg.name), "%s", name);
+	seg.start = start;
+	seg.size = size;
+	seg.bank = bank;
+
+	size_t pages = (size + DISASM_PAGE_SIZE - 1) / DISASM_PAGE_SIZE;
+	seg.pages.assign(pages, {});
+	seg.entry.assign(pages, 0);
+	seg.firstLine.assign(pages + 1, 0);
+}
+
+// Start decoding the freshly loaded ROM
+void Disassembly::build()
+{
+	stop();
+
+	Memory &memory = emu->memory;
+
+	// Work on a copy, padded so the last instruction can't read past it
+	size_t banks = std::max(memory.romLen / 0x4000, (size_t)1);
+	std::vector<uint8_t> bytes(banks * 0x4000 + 2, 0);
+	memcpy(bytes.data(), memory.rom, std::min(memory.romLen, banks * 0x4000));
+
+	romReady = 0;
+	rom.assign(banks, {});
+	for (size_t bank = 0; bank < banks; bank++) {
+		char name[8];
+		snprintf(name, sizeof(name), "ROM%02zX", bank);
+		initSegment(rom[bank], name, bank ? 0x4000 : 0x0000, 0x4000, bank);
+	}
+
+	invalidateRam();
+
+	cancel = false;
+	builder = std::thread([this, bytes = std::move(bytes)] {
+		for (size_t bank = 0; bank < rom.size() and not cancel; bank++) {
+			segment_t &seg = rom[bank];
+			for (size_t page = 0; page < seg.pages.size(); page++) {
+				uint8_t carry = decodePage(seg, page, bytes.data() + bank * 0x4000);
+				if (page + 1 < seg.pages.size()) {
+					seg.entry[page + 1] = carry;
+				}
+			}
+			updateFirstLines(seg);
+			romReady.store(bank + 1, std::memory_order_release);
+		}
+	});
+}
+
+// Decode one page of a segment, bytes holds the whole segment. Returns how
+// far the last instruction reaches into the next page.
+uint8_t Disassembly::decodePage(segment_t &seg, size_t page, const uint8_t *bytes)
+{
+	std::vector<line_t> &lines = seg.pages[page];
+	lines.clear();
+
+	size_t end = std::min((page + 1) * DISASM_PAGE_SIZE, (size_t)seg.size);
+	size_t offset = page * DISASM_PAGE_SIZE + seg.entry[page];
+
+	while (offset < end) {
+		line_t line;
+		line.addr = seg.start + offset;
+
+		line.label = emu->symbols.name(seg.bank, line.addr);
+		line.target = -1;
+		line.text[0] = '\0';
+		if (not line.label.empty()) {
+			line.len = 0;
+			lines.push_back(line);
+		}
+
+		line.label = {};
+		line.target = CPU::instructionTarget(bytes + offset, line.addr);
+		uint16_t next = CPU::instructionToString(bytes + offset, line.addr, line.text);
+		line.len = (uint16_t)(next - line.addr);
+		lines.push_back(line);
+
+		offset += line.len;
+	}
+
+	return offset - end;
+}
+
+void Disassembly::updateFirstLines(segment_t &seg)
+{
+	for (size_t page = 0; page < seg.pages.size(); page++) {
+		seg.firstLine[page + 1] = seg.firstLine[page] + seg.pages[page].size();
+	}
+}
+
+void Disassembly::codeWritten(uint16_t addr)
+{
+	if (addr >= 0xC000 and addr < 0xFE00) {
+		ramDirty[WRAM][(addr & 0x1FFF) / DISASM_PAGE_SIZE] = true; // including the echo
+	} else if (addr >= 0xFF80 and addr < 0xFFFF) {
+		ramDirty[HRAM][0] = true;
+	}
+}
+
+// Drops the decoded RAM as well. Its labels point into the symbol table,
+// which is reloaded along with the ROM, and the pages are only decoded
+// again once the disassembly is shown. Called on the GUI thread.
+void Disassembly::invalidateRam()
+{
+	for (int r = 0; r < RAM_SEGMENTS; r++) {
+		for (size_t page = 0; page < ram[r].pages.size(); page++) {
+			ram[r].pages[page].clear();
+			ramDirty[r][page] = true;
+		}
+		updateFirstLines(ram[r]);
+	}
+}
+
+void Disassembly::takeRamChanges()
+{
+	for (int r = 0; r < RAM_SEGMENTS; r++) {
+		segment_t &seg = ram[r];
+		bool written = false;
+		for (size_t page = 0; page < seg.pages.size(); page++) {
+			written |= ramDirty[r][page];
+			ramStale[r][page] |= ramDirty[r][page];
+			ramDirty[r][page] = false;
+		}
+		if (not written) {
+			continue;
+		}
+
+		// Padded so the last instruction can't read past it
+		ramBytes[r].assign(seg.size + 2, 0);
+		emu->memory.peekRange(seg.start, seg.size, MEMORY_BANK_CURRENT, ramBytes[r].data());
+	}
+}
+
+void Disassembly::refreshRam()
+{
+	for (int r = 0; r < RAM_SEGMENTS; r++) {
+		refreshRam((RamSegment)r);
+	}
+}
+
+// Redo the pages that were written, and following ones if instructions
+// now line up differently. Works on the copy takeRamChanges made.
+void Disassembly::refreshRam(RamSegment r)
+{
+	segment_t &seg = ram[r];
+	bool *stale = ramStale[r];
+	if (std::find(stale, stale + seg.pages.size(), true) == stale + seg.pages.size()) {
+		return;
+	}
+
+	for (size_t page = 0; page < seg.pages.size(); page++) {
+		if (not stale[page]) {
+			continue;
+		}
+		stale[page] = false;
+
+		uint8_t carry = decodePage(seg, page, ramBytes[r].data());
+		if (page + 1 < seg.pages.size() and seg.entry[page + 1] != carry) {
+			seg.entry[page + 1] = carry;
+			stale[page + 1] = true;
+		}
+	}
+	updateFirstLines(seg);
+}
+
+size_t Disassembly::segmentCount()
+{
+	return rom.size() + RAM_SEGMENTS;
+}
+
+Disassembly::segment_t *Disassembly::segment(size_t index)
+{
+	if (index < rom.size()) {
+		return index < romReady.load(std::memory_order_acquire) ? &rom[index] : nullptr;
+	}
+
+	index -= rom.size();
+	if (index >= RAM_SEGMENTS) {
+		return nullptr;
+	}
+	return &ram[index];
+}
+
+// Segment for the address with the given or current banks, -1 if there's none
+int Disassembly::segmentAt(uint16_t addr, int bank)
+{
+	if (addr < 0x4000) {
+		return rom.empty() ? -1 : 0;
+	}
+	if (addr < 0x8000) {
+		if (bank == MEMORY_BANK_CURRENT) {
+			bank = emu->memory.mbc == Memory::MBC::NONE ? 1 : emu->memory.romBank;
+		}
+		return bank > 0 and bank < (int)rom.size() ? bank : -1;
+	}
+	if (addr >= 0xC000 and addr < 0xE000) {
+		return rom.size() + WRAM;
+	}
+	if (addr >= 0xFF80 and addr < 0xFFFF) {
+		return rom.size() + HRAM;
+	}
+	return -1;
+}
+
+size_t Disassembly::lineCount(segment_t const &seg)
+{
+	return seg.firstLine.back();
+}
+
+Disassembly::line_t const &Disassembly::line(segment_t const &seg, size_t n)
+{
+	size_t page = std::upper_bound(seg.firstLine.begin(), seg.firstLine.end(), n) - seg.firstLine.begin() - 1;
+	return seg.pages[page][n - seg.firstLine[page]];
+}
+
+// Line of the instruction covering addr, or its label
+size_t Disassembly::lineAt(segment_t const &seg, uint16_t addr)
+{
+	size_t page = (addr - seg.start) / DISASM_PAGE_SIZE;
+	std::vector<line_t> const &lines = seg.pages[page];
+
+	auto it = std::upper_bound(lines.begin(), lines.end(), addr,
+		[](uint16_t addr, line_t const &line) { return addr < line.addr; });
+	if (it == lines.begin()) {
+		if (page == 0 or seg.pages[page - 1].empty()) {
+			return seg.firstLine[page];
+		}
+
+		// Inside an instruction continuing from the previous page
+		page--;
+		it = seg.pages[page].end();
+	}
+	std::vector<line_t> const &found = seg.pages[page];
+
+	// Back up to the first line with that address, which is the label
+	size_t index = it - found.begin() - 1;
+	while (index > 0 and found[index - 1].addr == found[index].addr) {
+		index--;
+	}
+	return seg.firstLine[page] + index;
+}
@@ -0,0 +1,97 @@
+#ifndef INCLUDED_DISASM_H
+#define INCLUDED_DISASM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <thread>
+struct Dromaius;
+
+#define DISASM_PAGE_SIZE 256
+#define DISASM_TEXT_SIZE 24
+
+// Disassembly of the whole ROM, every bank, for the debugger. ROM banks are
+// decoded once on a background thread after loading. Code in RAM is
+// decoded on demand and only redone for pages that were written since.
+struct Disassembly
+{
+	typedef struct line_s {
+		uint16_t addr;
+		uint8_t len; // 0 for a label line
+		std::string_view label; // symbol from the .sym file, for label lines
+		int32_t target; // of a jump or call, -1 if it isn't one
+		char text[DISASM_TEXT_SIZE];
+	} line_t;
+
+	// A range of the address space with one bank mapped in, decoded per
+	// page. An instruction that crosses into the next page belongs to the
+	// page it starts in.
+	typedef struct segment_s {
+		char name[8];
+		uint16_t start;
+		uint32_t size;
+		uint8_t bank;
+		std::vector<std::vector<line_t>> pages;
+		std::vector<uint8_t> entry; // offset of the first instruction per page
+		std::vector<size_t> firstLine; // per page, plus the total at the end
+	} segment_t;
+
+	enum RamSegment {
+		WRAM,
+		HRAM,
+		RAM_SEGMENTS
+	};
+
+	// Up-reference
+	Dromaius *emu;
+
+	// ROM0, then one per switchable bank. Only the first romReady are
+	// complete, the rest is still being decoded.
+	std::vector<segment_t> rom;
+	std::atomic<size_t> romReady = 0;
+	segment_t ram[RAM_SEGMENTS];
+	bool ramDirty[RAM_SEGMENTS][0x2000 / DISASM_PAGE_SIZE]; // per page, set by the emulation
+	bool ramStale[RAM_SEGMENTS][0x2000 / DISASM_PAGE_SIZE]; // taken over by the GUI
+	std::vector<uint8_t> ramBytes[RAM_SEGMENTS]; // copied when pages went stale
+
+	std::thread builder;
+	std::atomic<bool> cancel = false;
+
+	~Disassembly();
+
+	void initialize();
+	void build();
+	void stop();
+
+	// Memory writes to RAM that may hold code
+	void codeWritten(uint16_t addr);
+	void invalidateRam();
+
+	// Take over the pages that were written and copy their RAM, while the
+	// emulation is held between frames. Decoding happens later in
+	// refreshRam, without holding it up. Segments read by the GUI only
+	// change there.
+	void takeRamChanges();
+	void refreshRam();
+
+	// Segments are numbered ROM banks first, then RAM. Returns nullptr for
+	// a ROM bank that isn't decoded yet. The bank applies to 4000-7FFF.
+	size_t segmentCount();
+	segment_t *segment(size_t index);
+	int segmentAt(uint16_t addr, int bank = MEMORY_BANK_CURRENT);
+
+	size_t lineCount(segment_t const &seg);
+	line_t const &line(segment_t const &seg, size_t n);
+	size_t lineAt(segment_t const &seg, uint16_t addr);
+
+private:
+	void initSegment(segment_t &seg, const char *name, uint16_t start, uint32_t size, uint8_t bank);
+	uint8_t decodePage(segment_t &seg, size_t page, const uint8_t *bytes);
+	void updateFirstLines(segment_t &seg);
+	void refreshRam(RamSegment r);
+};
+
+#endif
@@ -15,9 +15,35 @@ Dromaius::Dromaius(settings_t settings)
 	memory.emu = this;
 	audio.emu = this;
 	gui.emu = this;
+	pacer.emu = this;
+	perf.emu = this;
+	symbols.emu = this;
+	disassembly.emu = this;
+	analyzer.emu = this;
+	profiler.emu = this;
+	logger.emu = this;
+
+	disassembly.initialize();
+	perf.initialize();
 
 	// Save the settings
 	this->settings = settings;
+
+	frameCount = 0;
+	lastDrawnTicks = 0;
+	skippedFrames = 0;
+
+	speed = 0;
+	speedFrames = 0;
+	speedTicks = 0;
+
+	running = false;
+	samplesPlayed = 0;
+	audioTarget = AUDIO_SAMPLE_RATE * settings.audioLatency / 1000;
+	audioUnderruns = 0;
+	audioOverruns = 0;
+	audioStarved = true;
+	audioTrim = false;
 }
 
 bool Dromaius::initializeWithRom(std::string const filename)
@@ -25,11 +51,23 @@ bool Dromaius::initializeWithRom(std::string const filename)
 	// Save the ROM filename
 	this->filename = filename;
 
+	// The background workers and the decoded RAM read the symbols, which
+	// are about to be replaced, even if loading fails
+	disassembly.stop();
+	disassembly.invalidateRam();
+	analyzer.stop();
+
 	// Reset and re-initialize state
 	reset();
 
 	// Load the ROM from file into memory
-	return memory.loadRom(this->filename);
+	if (not memory.loadRom(this->filename)) {
+		return false;
+	}
+
+	disassembly.build();
+	analyzer.analyze(this->filename);
+	return true;
 }
 
 void Dromaius::unloadRom() {
@@ -44,6 +82,7 @@ void Dromaius::reset()
 	input.initialize();
 	memory.initialize();
 	audio.initialize();
+	profiler.reset();
 }
 
 void Dromaius::saveState(uint8_t slot)
@@ -65,6 +104,8 @@ void Dromaius::saveState(uint8_t slot)
 	file.write((const char *)state, sizeof(state));
 }
 
+// Called by the GUI thread while holding stateMutex, it owns the GL objects
+// that are written over and put back here
 bool Dromaius::loadState(uint8_t slot)
 {
 	size_t expectedLen = sizeof(Audio) + sizeof(CPU) + sizeof(Graphics) + sizeof(Input) + sizeof(Memory);
@@ -90,12 +131,17 @@ bool Dromaius::loadState(uint8_t slot)
 	// Save pointers before overwriting
 	uint8_t *rom = memory.rom;
 	auto stepMode = cpu.stepMode;
+	SDL_AudioDeviceID audioDev = audio.dev;
+	SDL_AudioSpec audioSpec = audio.have;
 
-	// Save non-pointers by deep copy
-	uint8_t *addrToSymbol = new uint8_t[sizeof(memory.addrToSymbol)];
-	uint8_t *symbolToAddr = new uint8_t[sizeof(memory.symbolToAddr)];
-	memcpy(addrToSymbol, (uint8_t *)(&memory.addrToSymbol), sizeof(memory.addrToSymbol));
-	memcpy(symbolToAddr, (uint8_t *)(&memory.symbolToAddr), sizeof(memory.symbolToAddr));
+	// GL objects belong to this session, not to the savestate
+	uint32_t screenTexture = graphics.screenTexture;
+	uint32_t screenPBO[2] = { graphics.screenPBO[0], graphics.screenPBO[1] };
+	uint8_t screenPBOIndex = graphics.screenPBOIndex;
+	uint64_t uploadedFrameHash = graphics.uploadedFrameHash;
+	uint32_t debugTexture = graphics.debugTexture;
+	uint32_t debugMapTexture[2] = { graphics.debugMapTexture[0], graphics.debugMapTexture[1] };
+	uint32_t debugOAMTexture = graphics.debugOAMTexture;
 
 	// Overwrite all state
 	uint8_t *src = state;
@@ -109,106 +155,281 @@ bool Dromaius::loadState(uint8_t slot)
 	memory.rom = rom;
 	audio.emu = cpu.emu = graphics.emu = input.emu = memory.emu = this;
 	cpu.stepMode = stepMode;
+	audio.dev = audioDev;
+	audio.have = audioSpec;
+	graphics.screenTexture = screenTexture;
+	memcpy(graphics.screenPBO, screenPBO, sizeof(screenPBO));
+	graphics.screenPBOIndex = screenPBOIndex;
+	graphics.uploadedFrameHash = uploadedFrameHash;
+	graphics.debugTexture = debugTexture;
+	memcpy(graphics.debugMapTexture, debugMapTexture, sizeof(debugMapTexture));
+	graphics.debugOAMTexture = debugOAMTexture;
 
-	// Restore non-pointers by deep copy
-	memcpy((uint8_t *)(&memory.addrToSymbol), addrToSymbol, sizeof(memory.addrToSymbol));
-	memcpy((uint8_t *)(&memory.symbolToAddr), symbolToAddr, sizeof(memory.symbolToAddr));
+	// Debug views were drawn from the old state
+	graphics.invalidateDebugViews();
+	disassembly.invalidateRam();
+	profiler.clearStack();
 
 	return true;
 }
 
-void Dromaius::run()
+// Decide whether the next frame is drawn. Skipped frames are still
+// emulated, the PPU just doesn't produce pixels for them.
+bool Dromaius::shouldSkipFrame(uint32_t now)
 {
-	// Instruction loop
-	bool done = false;
-	while (not done) {
-		int oldTime = SDL_GetTicks();
-
-		// Skip all logic if no ROM is loaded
-		if (memory.romLoaded) {
-			if (cpu.stepMode and cpu.stepInst) {
-				// Perform one CPU instruction
-				if (not cpu.executeInstruction()) {
-					done = 1;
-					break;
-				}
-				graphics.step();
-				
-				cpu.stepInst = false;
-			} else if (not cpu.stepMode or cpu.stepFrame) {
-				// Do a frame
-				graphics.renderDebugTileset();
+	bool skip;
+
+	if (not memory.romLoaded or cpu.stepMode) {
+		skip = false;
+	} else if (settings.frameSkip > 1) {
+		// Fixed: draw 1 of every N frames
+		skip = (frameCount % settings.frameSkip) != 0;
+	} else if (settings.frameSkip == 0) {
+		// Automatic: when fast-forwarding, draw at most at display rate,
+		// otherwise only skip to catch up with real time
+		if (cpu.fastForward) {
+			skip = now - lastDrawnTicks < FRAME_TIME_MS;
+		} else {
+			skip = pacer.lagMicros() > FRAME_TIME_US;
+		}
+		skip = skip and skippedFrames < MAX_FRAMESKIP;
+	} else {
+		skip = false;
+	}
+
+	if (not skip) {
+		lastDrawnTicks = now;
+	}
+	skippedFrames = skip ? skippedFrames + 1 : 0;
+	return skip;
+}
+
+// Key events from the GUI thread, applied between frames
+void Dromaius::handleKey(key_event_t const &event)
+{
+	if (not event.down) {
+		input.handleGameInput(1, event.key);
+		return;
+	}
+
+	switch (event.key) {
+		case SDLK_F1: // toggle: debugging on every instruction
+			settings.debug = !settings.debug;
+			break;
+			
+		case SDLK_F2: // debug Graphics
+			graphics.printDebug();
+			cpu.printRegisters();
+			break;
 				
-				// Step CPU
-				unsigned long long frametime = cpu.c + CPU_CLOCKS_PER_FRAME;
-				while (cpu.c < frametime) {
+		case SDLK_F3: // dump memory contents to file
+			memory.dumpToFile("memdump.bin");
+			break;
+		
+		case SDLK_r: // reset
+			reset();
+			break;
+
+		case SDLK_SPACE:
+			cpu.stepInst = true;
+			break;
+
+		case SDLK_f:
+			cpu.stepFrame = true;
+			break;
+
+		case SDLK_TAB: // toggle turbo
+			cpu.fastForward = !cpu.fastForward;
+			break;
+		
+		default:
+			if (not event.captured) {
+				input.handleGameInput(0, event.key);
+			}
+			break;
+	}
+}
+
+// Commands from the GUI thread, applied between frames like keys
+void Dromaius::handleCommand(command_t const &command)
+{
+	switch (command.type) {
+		case RESET:
+			reset();
+			break;
+
+		case UNLOAD_ROM:
+			unloadRom();
+			break;
+
+		case DUMP_MEMORY:
+			memory.dumpToFile("memdump.bin");
+			break;
+
+		case SET_TURBO:
+			cpu.fastForward = command.value;
+			break;
+
+		case SET_STEP_MODE:
+			cpu.stepMode = command.value;
+			break;
+
+		case STEP_INSTRUCTION:
+			cpu.stepInst = true;
+			break;
+
+		case STEP_FRAME:
+			cpu.stepFrame = true;
+			break;
+
+		case CLEAR_PROFILE:
+			profiler.clearStats();
+			break;
+
+		case EXPORT_PROFILE:
+			profiler.exportToFile("profile.csv");
+			break;
+
+		case POKE:
+			memory.writeByte(command.value, command.addr);
+			break;
+	}
+}
+
+// Emulation thread
+void Dromaius::emulate()
+{
+	pacer.initialize();
+	perf.start(perf.emulation);
+
+	while (running) {
+		int speedMultiplier;
+
+		{
+			// The GUI only sees state between frames
+			std::lock_guard<std::mutex> lock(stateMutex);
+			perf.endFrame(perf.emulation);
+
+			key_event_t key;
+			while (keyQueue.pop(key)) {
+				handleKey(key);
+			}
+
+			command_t command;
+			while (commandQueue.pop(command)) {
+				handleCommand(command);
+			}
+
+			graphics.skipRequested = shouldSkipFrame(SDL_GetTicks());
+			frameCount++;
+
+			// Skip all logic if no ROM is loaded
+			if (memory.romLoaded) {
+				Perf::sample_t &sample = perf.emulation.current;
+				Perf::Timer timer(sample, Perf::CPU);
+				unsigned long long startCycles = cpu.c;
+
+				if (cpu.stepMode and cpu.stepInst) {
+					// Perform one CPU instruction
 					if (not cpu.executeInstruction()) {
-						done = 1;
+						running = false;
 						break;
 					}
-
 					graphics.step();
+					sample.instructions++;
+					
+					cpu.stepInst = false;
+					Perf::Timer apuTimer(sample, Perf::APU);
+					audio.runUntil(cpu.c * 4);
+					audio.flushSamples();
+				} else if (not cpu.stepMode or cpu.stepFrame) {
+					// Do a frame
+					// Step CPU
+					unsigned long long frametime = cpu.c + CPU_CLOCKS_PER_FRAME;
+					uint32_t instructions = 0;
+					while (cpu.c < frametime) {
+						if (not cpu.executeInstruction()) {
+							running = false;
+							break;
+						}
+
+						graphics.step();
+						instructions++;
+					}
+					sample.instructions += instructions;
+
+					profiler.endFrame();
+					{
+						Perf::Timer apuTimer(sample, Perf::APU);
+						audio.runUntil(cpu.c * 4);
+						audio.flushSamples();
+					}
+					cpu.stepFrame = false;
+					speedFrames++;
 				}
+				sample.cycles += cpu.c - startCycles;
+			}
 
-				cpu.stepFrame = false;
+			// Measure achieved speed twice a second
+			uint32_t now = SDL_GetTicks();
+			if (now - speedTicks >= 500) {
+				speed = speedFrames * (float)FRAME_TIME_US / ((now - speedTicks) * 1000.0f);
+				speedFrames = 0;
+				speedTicks = now;
 			}
+
+			speedMultiplier = cpu.fastForward ? settings.turboSpeed : 1;
 		}
 
-		// Always render frames, for UI to work
-		graphics.renderFrame();
-		
+		// Wait out the rest of the frame, shortened by the turbo multiplier
+		Perf::Timer timer(perf.emulation.current, Perf::SLEEP);
+		pacer.waitForFrame(speedMultiplier);
+	}
+}
+
+// GUI thread: events and rendering at display refresh, emulation runs on
+// its own thread so a slow GUI frame doesn't hold it up
+void Dromaius::run()
+{
+	gui.initDisplay();
+	graphics.initDisplay();
+
+	running = true;
+	emuThread = std::thread(&Dromaius::emulate, this);
+	perf.start(perf.display);
+
+	while (running) {
+		uint32_t oldTime = SDL_GetTicks();
+		perf.endFrame(perf.display);
+
 		// SDL event loop
 		SDL_Event event;
 		while (SDL_PollEvent(&event)) {
 			ImGui_ImplSDL2_ProcessEvent(&event);
 			ImGuiIO& io = ImGui::GetIO();
 
-			if (event.type == SDL_KEYDOWN) {
-				switch (event.key.keysym.sym) {
-					case SDLK_F1: // toggle: debugging on every instruction
-						settings.debug = !settings.debug;
-						break;
-						
-					case SDLK_F2: // debug Graphics
-						graphics.printDebug();
-						cpu.printRegisters();
-						break;
-							
-					case SDLK_F3: // dump memory contents to file
-						memory.dumpToFile("memdump.bin");
-						break;
-					
-					case SDLK_r: // reset
-						reset();
-						break;
-
-					case SDLK_SPACE:
-						cpu.stepInst = true;
-						break;
-
-					case SDLK_f:
-						cpu.stepFrame = true;
-						break;
-					
-					default:
-						if (not io.WantCaptureKeyboard) {
-							input.handleGameInput(0, event.key.keysym.sym);
-						}
-						break;
+			if (event.type == SDL_KEYDOWN or event.type == SDL_KEYUP) {
+				key_event_t key = { event.key.keysym.sym, event.type == SDL_KEYDOWN, io.WantCaptureKeyboard };
+				if (not keyQueue.push(key)) {
+					printf("Key queue full, dropping key event\n");
 				}
 			}
-			else if (event.type == SDL_KEYUP) {
-				input.handleGameInput(1, event.key.keysym.sym);
-			}
 			else if (event.type == SDL_QUIT ||
 				(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE)) {
-				done = true;
+				running = false;
 			}
 		}
-		
+
+		// Render frames even without a ROM, for UI to work
+		graphics.renderFrame();
+
+		// Swapping waits for vsync, otherwise wait here
 		uint32_t deltaTime = SDL_GetTicks() - oldTime;
-		if (deltaTime > 0 and deltaTime < 16 and not cpu.fastForward) {
-			SDL_Delay(16 - deltaTime);
+		if (not gui.vsync and deltaTime < FRAME_TIME_MS) {
+			Perf::Timer timer(perf.display.current, Perf::SLEEP);
+			SDL_Delay(FRAME_TIME_MS - deltaTime);
 		}
 	}
-}
\ No newline at end of file
+
+	emuThread.join();
+}
@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <imgui.h>
 #include <imgui_internal.h>
 #include <imfilebrowser.h>
@@ -12,46 +15,53 @@
 #include "audio.h"
 #include "cpu.h"
 #include "graphics.h"
+#include "settings.h"
 #include "gui.h"
 #include "input.h"
 #include "memory.h"
+#include "pacer.h"
+#include "perf.h"
+#include "symbols.h"
+#include "disasm.h"
+#include "analyzer.h"
+#include "profiler.h"
+#include "logger.h"
+#include "lockfree.h"
 #include "games/games.h"
 
-typedef struct keymap_s {
-	int start;
-	int startDown;
-	
-	int select;
-	int selectDown;
-	
-	int left;
-	int leftDown;
-	
-	int up;
-	int upDown;
-	
-	int right;
-	int rightDown;
-	
-	int down;
-	int downDown;
-	
-	int b;
-	int bDown;
-	
-	int a;
-	int aDown;
-} keymap_t;
+typedef struct key_event_s {
+	SDL_Keycode key;
+	bool down;
+	bool captured; // keyboard focus was on the GUI
+} key_event_t;
 
+// Changes the GUI asks for, applied by the emulation thread between frames
+typedef struct command_s {
+	uint8_t type; // Dromaius::Command
+	uint16_t addr;
+	int value;
+} command_t;
 
-typedef struct settings_s {
-	int debug;
-	keymap_t keymap;
-} settings_t;
+typedef struct frame_s {
+	uint8_t pixels[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT]; // shade indices (0-3)
+} frame_t;
 
 
 struct Dromaius
 {
+	enum Command : uint8_t {
+		RESET,
+		UNLOAD_ROM,
+		DUMP_MEMORY,
+		SET_TURBO, // value is on or off
+		SET_STEP_MODE,
+		STEP_INSTRUCTION,
+		STEP_FRAME,
+		CLEAR_PROFILE,
+		EXPORT_PROFILE,
+		POKE, // write value to addr
+	};
+
 	// GB subcomponents
 	CPU cpu;
 	Graphics graphics;
@@ -61,11 +71,46 @@ struct Dromaius
 
 	// Emulator subcomponents
 	GUI gui;
+	Pacer pacer;
+	Perf perf;
+	Symbols symbols;
+	Disassembly disassembly;
+	Analyzer analyzer;
+	Profiler profiler;
+	Logger logger;
 	settings_t settings;
 
 	// State
 	std::string filename;
 
+	// Frame skipping
+	uint32_t frameCount;
+	uint32_t lastDrawnTicks;
+	int skippedFrames; // in a row
+
+	// Achieved emulation speed, 1.0 = real time
+	float speed;
+	uint32_t speedFrames;
+	uint32_t speedTicks;
+
+	// Emulation runs on its own thread and holds stateMutex while running
+	// a frame. The GUI thread holds it only to copy what the debugger
+	// windows show, so they always see the state between two frames.
+	std::thread emuThread;
+	std::mutex stateMutex;
+	std::atomic<bool> running;
+	SPSCQueue<key_event_t, 64> keyQueue; // GUI -> emulation
+	SPSCQueue<command_t, 256> commandQueue; // GUI -> emulation
+	TripleBuffer<frame_t> frames; // emulation -> GUI
+	SPSCQueue<int16_t, AUDIO_BUFFER_SIZE> audioBuffer; // emulation -> audio device
+	CaptureRing<int8_t, AUDIO_SCOPE_SIZE> scope[4]; // emulation -> GUI, channel levels
+	std::atomic<uint32_t> samplesPlayed; // by the audio device
+	std::atomic<uint32_t> audioTarget; // samples to keep queued
+	std::atomic<uint32_t> audioUnderruns; // device found the queue empty
+	std::atomic<uint32_t> audioOverruns; // queue was full, samples dropped
+	bool audioStarved; // only touched by the audio callback
+	std::atomic<bool> audioTrim; // device drops what's queued above the target
+
 	Dromaius(settings_t settings);
 
 	bool initializeWithRom(std::string const filename);
@@ -76,6 +121,10 @@ struct Dromaius
 	void saveState(uint8_t slot);
 	bool loadState(uint8_t slot);
 	
+	bool shouldSkipFrame(uint32_t now);
+	void handleKey(key_event_t const &event);
+	void handleCommand(command_t const &command);
+	void emulate();
 	void run();
 };
 
@@ -86,7 +135,12 @@ struct Dromaius
 #define TILEMAP_ADDR0   0x1800
 #define TILEMAP_ADDR1   0x1C00
 
+#define GB_CLOCK_RATE        4194304 // clock cycles per second
+#define GB_CLOCKS_PER_FRAME  70224
 #define CPU_CLOCKS_PER_FRAME 17556 // 70224 / 4 clock cycles
+#define FRAME_TIME_MS        16
+#define FRAME_TIME_US        16743 // 70224 / 4.194304 MHz
+#define MAX_FRAMESKIP        8 // draw at least this often, even when behind
 
 // Stubs for function definitions
 struct SDL_Window;
@@ -1,3 +1,4 @@
 #include "../dromaius.h"
 
-void gameGUI_pokemon_red(Dromaius *emu);
\ No newline at end of file
+// Edits work RAM in place
+void gameGUI_pokemon_red(uint8_t *workram);
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <map>
 #include "games.h"
 
 // https://datacrystal.romhacking.net/wiki/Pok%C3%A9mon_Red/Blue:RAM_map
@@ -181,7 +182,7 @@ typedef struct pokemon_s
 } __attribute__((packed)) pokemon_t;
 
 // Read at most `length` poke-encoded characters from `addr`
-std::string getPokeStringAt(Dromaius *emu, uint16_t addr, uint16_t len) {
+std::string getPokeStringAt(uint8_t *workram, uint16_t addr, uint16_t len) {
 	std::string str;
 
 	const char charMap[255] = 
@@ -190,7 +191,7 @@ std::string getPokeStringAt(Dromaius *emu, uint16_t addr, uint16_t len) {
 		"\"PM-rm?!.   >>vM$*./,F0123456789";
 
 	for (int i = 0; i < len; ++i) {
-		uint8_t b = emu->memory.readByte(addr + i);
+		uint8_t b = workram[addr - 0xC000 + i];
 		if (b == 0x50) {
 			// 0x50 is the string delimiter
 			break;
@@ -207,23 +208,23 @@ std::string getPokeStringAt(Dromaius *emu, uint16_t addr, uint16_t len) {
 	return str;
 }
 
-void renderBadges(Dromaius *emu) {
+void renderBadges(uint8_t *workram) {
 	// Bitmap at 0xD356
-	ImGui::CheckboxFlags("Boulder", (int *)&emu->memory.workram[0x1356], 0x01);
+	ImGui::CheckboxFlags("Boulder", (int *)&workram[0x1356], 0x01);
 	ImGui::SameLine();
-	ImGui::CheckboxFlags("Cascade", (int *)&emu->memory.workram[0x1356], 0x02);
-	ImGui::CheckboxFlags("Thunder", (int *)&emu->memory.workram[0x1356], 0x04);
+	ImGui::CheckboxFlags("Cascade", (int *)&workram[0x1356], 0x02);
+	ImGui::CheckboxFlags("Thunder", (int *)&workram[0x1356], 0x04);
 	ImGui::SameLine();
-	ImGui::CheckboxFlags("Rainbow", (int *)&emu->memory.workram[0x1356], 0x08);
-	ImGui::CheckboxFlags("Soul   ", (int *)&emu->memory.workram[0x1356], 0x10);
+	ImGui::CheckboxFlags("Rainbow", (int *)&workram[0x1356], 0x08);
+	ImGui::CheckboxFlags("Soul   ", (int *)&workram[0x1356], 0x10);
 	ImGui::SameLine();
-	ImGui::CheckboxFlags("Marsh  ", (int *)&emu->memory.workram[0x1356], 0x20);
-	ImGui::CheckboxFlags("Volcano", (int *)&emu->memory.workram[0x1356], 0x40);
+	ImGui::CheckboxFlags("Marsh  ", (int *)&workram[0x1356], 0x20);
+	ImGui::CheckboxFlags("Volcano", (int *)&workram[0x1356], 0x40);
 	ImGui::SameLine();
-	ImGui::CheckboxFlags("Earth  ", (int *)&emu->memory.workram[0x1356], 0x80);
+	ImGui::CheckboxFlags("Earth  ", (int *)&workram[0x1356], 0x80);
 }
 
-void renderItems(Dromaius *emu, bool stored = false) {
+void renderItems(uint8_t *workram, bool stored = false) {
 	uint8_t const zero = 0;
 	uint8_t const twofivefour = 254;
 	uint8_t const twofivefive = 255;
@@ -249,7 +250,7 @@ void renderItems(Dromaius *emu, bool stored = false) {
 	int i;
 	for (i = 0; i < max; ++i) {
 		// List is 0xFF-terminated
-		if (emu->memory.workram[baseAddr + 1 + i * 2] == 0xFF) {
+		if (workram[baseAddr + 1 + i * 2] == 0xFF) {
 			++i;
 			break;
 		}
@@ -257,14 +258,14 @@ void renderItems(Dromaius *emu, bool stored = false) {
 		ImGui::TableNextColumn();
 		ImGui::PushID(i*2);
 		ImGui::PushItemWidth(-1);
-		uint8_t itemNr = emu->memory.workram[baseAddr + 1 + i * 2];
+		uint8_t itemNr = workram[baseAddr + 1 + i * 2];
 		if (poke_item_names.contains(itemNr)) {
 			char displayBuf[100];
 			sprintf(displayBuf, "%d (%s)", itemNr,
 				poke_item_names[itemNr]);
-			ImGui::DragScalar("##item", ImGuiDataType_U8, &emu->memory.workram[baseAddr + 1 + i * 2], 0.5, &zero, &twofivefour, displayBuf);
+			ImGui::DragScalar("##item", ImGuiDataType_U8, &workram[baseAddr + 1 + i * 2], 0.5, &zero, &twofivefour, displayBuf);
 		} else {
-			ImGui::DragScalar("##item", ImGuiDataType_U8, &emu->memory.workram[baseAddr + 1 + i * 2], 0.5, &zero, &twofivefour);
+			ImGui::DragScalar("##item", ImGuiDataType_U8, &workram[baseAddr + 1 + i * 2], 0.5, &zero, &twofivefour);
 		}
 		ImGui::PopItemWidth();
 		ImGui::PopID();
@@ -272,7 +273,7 @@ void renderItems(Dromaius *emu, bool stored = false) {
 		ImGui::TableNextColumn();
 		ImGui::PushID(i*2+1);
 		ImGui::PushItemWidth(-1);
-		ImGui::DragScalar("##count", ImGuiDataType_U8, &emu->memory.workram[baseAddr + 2 + i * 2], 0.5, &zero, &twofivefive, "Count: %d");
+		ImGui::DragScalar("##count", ImGuiDataType_U8, &workram[baseAddr + 2 + i * 2], 0.5, &zero, &twofivefive, "Count: %d");
 		ImGui::PopItemWidth();
 		ImGui::PopID();
 	}
@@ -281,24 +282,24 @@ void renderItems(Dromaius *emu, bool stored = false) {
 	// If the list is not full
 	if (i < max && ImGui::Button("Add item")) {
 		// Remove list terminator
-		emu->memory.workram[baseAddr + 1 + (i-1) * 2] = 0x00;
+		workram[baseAddr + 1 + (i-1) * 2] = 0x00;
 
 		// Add a new terminator if this is not the last item
 		if (i < max) {
-			emu->memory.workram[baseAddr + 1 + i * 2] = 0xFF;
+			workram[baseAddr + 1 + i * 2] = 0xFF;
 		}
 
 		// Update total item count (0xD31D)
-		emu->memory.workram[baseAddr] = i;
+		workram[baseAddr] = i;
 	}
 	// ImGui::SameLine();
 	if (i > 1 && ImGui::Button("Remove last")) {
-		emu->memory.workram[baseAddr + 1 + (i-2) * 2] = 0xFF;
+		workram[baseAddr + 1 + (i-2) * 2] = 0xFF;
 	}
 	ImGui::PopID();
 }
 
-void renderParty(Dromaius *emu) {
+void renderParty(uint8_t *workram) {
 
 	uint16_t partyBase = 0xD163 - 0xC000;
 	uint16_t trainerNameBase = 0xD273;
@@ -307,12 +308,12 @@ void renderParty(Dromaius *emu) {
 
 	uint8_t const s = 1;
 
-	uint8_t partyCnt = emu->memory.workram[partyBase];
+	uint8_t partyCnt = workram[partyBase];
 	for (int i = 0; i < partyCnt; ++i) {
-		uint8_t mon = emu->memory.workram[partyBase + 1 + i];
-		auto monNick = getPokeStringAt(emu, nicknameBase + i * 10, 10);
-		auto monTrainer = getPokeStringAt(emu, trainerNameBase + i * 10, 10);
-		auto monData = (pokemon_t *)&emu->memory.workram[monDataBase + sizeof(pokemon_t) * i];
+		uint8_t mon = workram[partyBase + 1 + i];
+		auto monNick = getPokeStringAt(workram, nicknameBase + i * 10, 10);
+		auto monTrainer = getPokeStringAt(workram, trainerNameBase + i * 10, 10);
+		auto monData = (pokemon_t *)&workram[monDataBase + sizeof(pokemon_t) * i];
 
 
 		ImGui::PushID(i);
@@ -320,9 +321,9 @@ void renderParty(Dromaius *emu) {
 		if (ImGui::TreeNode(title.c_str())) {
 
 			ImGui::Text("Trainer: %s, ID: %d", monTrainer.c_str(), monData->trainerId);
-			ImGui::InputScalar("Index nr.", ImGuiDataType_U8, &emu->memory.workram[partyBase + 1 + i], &s);
+			ImGui::InputScalar("Index nr.", ImGuiDataType_U8, &workram[partyBase + 1 + i], &s);
 			// Make sure both datapoints are in sync
-			monData->index = emu->memory.workram[partyBase + 1 + i];
+			monData->index = workram[partyBase + 1 + i];
 
 			ImGui::InputScalar("Level", ImGuiDataType_U8, &monData->level, &s);
 			ImGui::InputScalar("HP", ImGuiDataType_U8, &monData->hp, &s);
@@ -385,19 +386,19 @@ void renderParty(Dromaius *emu) {
 
 }
 
-void gameGUI_pokemon_red(Dromaius *emu) {
+void gameGUI_pokemon_red(uint8_t *workram) {
 	uint8_t const s = 1;
 	
-	auto const playerName = getPokeStringAt(emu, 0xD158, 0x10);
-	auto const rivalName = getPokeStringAt(emu, 0xD34A, 0x10);
+	auto const playerName = getPokeStringAt(workram, 0xD158, 0x10);
+	auto const rivalName = getPokeStringAt(workram, 0xD34A, 0x10);
 
 	// Basic info
 	ImGui::Text("player: %s, rival: %s", playerName.c_str(), rivalName.c_str());
 
 	if (ImGui::CollapsingHeader("Player")) {
 		// 0xD361
-		// ImGui::InputScalar("Player X", ImGuiDataType_U8, &emu->memory.workram[0x1362], &s);
-		// ImGui::InputScalar("Player Y", ImGuiDataType_U8, &emu->memory.workram[0x1361], &s);
+		// ImGui::InputScalar("Player X", ImGuiDataType_U8, &workram[0x1362], &s);
+		// ImGui::InputScalar("Player Y", ImGuiDataType_U8, &workram[0x1361], &s);
 	
 
 		
@@ -406,19 +407,19 @@ void gameGUI_pokemon_red(Dromaius *emu) {
 
 
 	if (ImGui::CollapsingHeader("Badges")) {
-		renderBadges(emu);
+		renderBadges(workram);
 	}
 
 	if (ImGui::CollapsingHeader("Items (player)")) {
-		renderItems(emu);
+		renderItems(workram);
 	}
 
 	if (ImGui::CollapsingHeader("Items (storage)")) {
-		renderItems(emu, true);
+		renderItems(workram, true);
 	}
 
 	if (ImGui::CollapsingHeader("Pokemon party")) {
-		renderParty(emu);
+		renderParty(workram);
 	}
 
 }
\ No newline at end of file
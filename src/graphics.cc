@@ -1,6 +1,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstdint>
+#include <array>
+#include <bit>
+#ifdef GRAPHICS_SIMD_RENDERER
+#include <tmmintrin.h>
+#endif
 #include "dromaius.h"
 
 
@@ -14,27 +19,19 @@ void Graphics::initialize()
 	r.scy = 0;
 	r.flags = 0;
 
-	// Default screen scale
-	// TODO: make setting
-	screenScale = 3;
-
 	// Initialize pixel buffers
 	memset(screenPixels, 0x00, sizeof(screenPixels));
-	memset(debugTilesetPixels, 0x00, sizeof(debugTilesetPixels));
+	skipRequested = false;
+	skippingFrame = false;
+	invalidateDebugViews();
 
 
 	// Initialize OAM and VRAM
 	memset(vram, 0x00, sizeof(vram));
 	memset(oam, 0x00, sizeof(oam));
 	
-	// Initialize tileset
-	for (int i = 0; i < 512; i++) {
-		for (int j = 0; j < 8; j++) {
-			for (int k = 0; k < 8; ++k) {
-				tileset[i][j][k] = 0x00;
-			}
-		}
-	}
+	// Tileset is decoded from VRAM on first use
+	memset(tilesDirty, 0xFF, sizeof(tilesDirty));
 	
 	// Initialize sprite data	
 	for (int i = 0; i < 40; i++) {
@@ -43,36 +40,144 @@ void Graphics::initialize()
 		spritedata[i].tile = 0;
 		spritedata[i].flags = 0;
 	}
+	memset(spriteLines, 0x00, sizeof(spriteLines));
 
-	initDisplay();
 	initialized = true;
 }
 
 
+// Allocate a texture's storage once, later updates only replace its contents
+static uint32_t createTexture(int width, int height)
+{
+	uint32_t texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
+		0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+// Called once from the GUI thread, GL objects live as long as the emulator
 void Graphics::initDisplay()
 {
 	// Create texture for game graphics
-	glGenTextures(1, &emu->graphics.screenTexture);
+	screenTexture = createTexture(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
+
+	// Pixel buffers for streaming frames into it
+	glGenBuffers(2, screenPBO);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, screenPBO[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT * 4, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	screenPBOIndex = 0;
+	uploadedFrameHash = 0;
+
+	// Create textures for video mem debug
+	debugTexture = createTexture(DEBUG_WIDTH, DEBUG_HEIGHT);
+	debugMapTexture[0] = createTexture(DEBUG_MAP_SIZE, DEBUG_MAP_SIZE);
+	debugMapTexture[1] = createTexture(DEBUG_MAP_SIZE, DEBUG_MAP_SIZE);
+	debugOAMTexture = createTexture(DEBUG_OAM_WIDTH, DEBUG_OAM_HEIGHT);
+	memset(debugTilesetPixels, 0x00, sizeof(debugTilesetPixels));
+	memset(debugMapPixels, 0x00, sizeof(debugMapPixels));
+	memset(debugOAMPixels, 0x00, sizeof(debugOAMPixels));
+	memset(debugTilesDirty, 0x00, sizeof(debugTilesDirty));
+	memset(debugMapDirty, 0x00, sizeof(debugMapDirty));
+	debugSpritesDirty = 0;
+}
+
+// Turn shade indices into RGBA pixels using a 4-color palette
+void Graphics::shadesToRGBA(const uint8_t *shades, uint32_t *out, size_t len, const uint32_t *palette)
+{
+	size_t i = 0;
+
+#ifdef GRAPHICS_SIMD_RENDERER
+	// One pshufb per channel looks up 16 pixels, unpacking interleaves them
+	__m128i lut[4];
+	for (int c = 0; c < 4; c++) {
+		lut[c] = _mm_setr_epi8(
+			palette[0] >> (8 * c), palette[1] >> (8 * c), palette[2] >> (8 * c), palette[3] >> (8 * c),
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	}
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i px = _mm_loadu_si128((__m128i *)&shades[i]);
+		__m128i r = _mm_shuffle_epi8(lut[0], px);
+		__m128i g = _mm_shuffle_epi8(lut[1], px);
+		__m128i b = _mm_shuffle_epi8(lut[2], px);
+		__m128i a = _mm_shuffle_epi8(lut[3], px);
+
+		__m128i rgLo = _mm_unpacklo_epi8(r, g), rgHi = _mm_unpackhi_epi8(r, g);
+		__m128i baLo = _mm_unpacklo_epi8(b, a), baHi = _mm_unpackhi_epi8(b, a);
+
+		_mm_storeu_si128((__m128i *)&out[i + 0], _mm_unpacklo_epi16(rgLo, baLo));
+		_mm_storeu_si128((__m128i *)&out[i + 4], _mm_unpackhi_epi16(rgLo, baLo));
+		_mm_storeu_si128((__m128i *)&out[i + 8], _mm_unpacklo_epi16(rgHi, baHi));
+		_mm_storeu_si128((__m128i *)&out[i + 12], _mm_unpackhi_epi16(rgHi, baHi));
+	}
+#endif
+
+	for (; i < len; i++) {
+		out[i] = palette[shades[i]];
+	}
+}
 
-	// Create texture for video mem debug
-	glGenTextures(1, &emu->graphics.debugTexture);
+// Identifies what the screen texture would show, so unchanged frames
+// (paused, static screens) aren't uploaded again
+uint64_t Graphics::frameHash(const uint8_t *pixels)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	const uint64_t *words = (const uint64_t *)pixels;
+	for (size_t i = 0; i < GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT / 8; i++) {
+		hash = (hash ^ words[i]) * 0x100000001b3;
+	}
+	for (int i = 0; i < 4; i++) {
+		hash = (hash ^ emu->settings.palette[i]) * 0x100000001b3;
+	}
+	return hash;
 }
 
+// Called from the present stage on the GUI thread, uploads the latest
+// frame the emulation thread published
 void Graphics::updateTextures()
 {
-	// Bind texture and upload pixels
-	glBindTexture(GL_TEXTURE_2D, screenTexture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT,
-		0, GL_RGBA, GL_UNSIGNED_BYTE, screenPixels);
+	emu->frames.update();
+	const uint8_t *framePixels = emu->frames.readBuffer().pixels;
 
-	// Bind texture and upload pixels
-	glBindTexture(GL_TEXTURE_2D, debugTexture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, DEBUG_WIDTH, DEBUG_HEIGHT,
-		0, GL_RGBA, GL_UNSIGNED_BYTE, debugTilesetPixels);
+	uint64_t hash = frameHash(framePixels);
+	if (hash == uploadedFrameHash) {
+		return;
+	}
+	uploadedFrameHash = hash;
+
+	// Palette conversion happens here, at present time, and nowhere else.
+	// Write this frame into one PBO while the driver may still be reading
+	// the other one, orphaning the old storage so mapping never waits.
+	const size_t len = GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT;
+	screenPBOIndex ^= 1;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, screenPBO[screenPBOIndex]);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, len * 4, nullptr, GL_STREAM_DRAW);
+	uint32_t *dest = (uint32_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, len * 4,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, screenTexture);
+	if (dest) {
+		shadesToRGBA(framePixels, dest, len, emu->settings.palette);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT,
+			GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	} else {
+		// Mapping failed, upload from client memory instead
+		static uint32_t screenRGBA[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT];
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		shadesToRGBA(framePixels, screenRGBA, len, emu->settings.palette);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT,
+			GL_RGBA, GL_UNSIGNED_BYTE, screenRGBA);
+	}
 
 	// Restore state
 	glBindTexture(GL_TEXTURE_2D, 0);
@@ -120,7 +225,7 @@ uint8_t Graphics::readByte(uint16_t addr)
 			return r.winx;
 
 		default:
-			printf("TODO! read from unimplemented 0x%02X\n", addr + 0xFF40);
+			LOG(emu, WARN, "TODO! read from unimplemented 0x%02X", addr + 0xFF40);
 			return 0x00; // TODO: Unhandled I/O, no idea what GB does here
 	}
 }
@@ -129,7 +234,13 @@ void Graphics::writeByte(uint8_t b, uint16_t addr)
 {
 	switch (addr) {
 		case 0x0:
-			r.flags = b;
+			if ((r.flags ^ b) & Flag::SPRITESIZE) {
+				// Sprite height changed, so every sprite's line span did too
+				r.flags = b;
+				rebuildSpriteLines();
+			} else {
+				r.flags = b;
+			}
 			break;
 
 		case 0x1: // LCD status, writing is only allowed on the interrupt enable flags
@@ -137,7 +248,7 @@ void Graphics::writeByte(uint8_t b, uint16_t addr)
 			vBlankInt = (b & 0x10 ? 1 : 0);	
 			OAMInt = (b & 0x20 ? 1 : 0);	
 			CoinInt = (b & 0x40 ? 1 : 0);
-			printf("written 0x%02X to lcd STAT\n", b);
+			LOG(emu, DEBUG, "written 0x%02X to lcd STAT", b);
 			break;
 		
 		case 0x2:
@@ -190,48 +301,70 @@ void Graphics::writeByte(uint8_t b, uint16_t addr)
 			break;
 
 		default:
-			printf("TODO! write to unimplemented VRAM var 0x%02X\n", addr + 0xFF40);
+			LOG(emu, WARN, "TODO! write to unimplemented VRAM var 0x%02X", addr + 0xFF40);
 			break;
 	}
 }
 
-// Draw it in bright color: 0 = red, 1 = green, 2 = blue
-inline void Graphics::setPixelColorDebug(int x, int y, uint8_t color)
+// Spreads the 8 bits of a byte to the even bits of a word. Interleaving the
+// two bitplanes of a tile row gives 2 bits per pixel, leftmost pixel on top.
+static constexpr auto tileInterleave = []() {
+	std::array<uint16_t, 256> lut{};
+	for (int b = 0; b < 256; b++) {
+		for (int bit = 0; bit < 8; bit++) {
+			lut[b] |= ((b >> bit) & 1) << (2 * bit);
+		}
+	}
+	return lut;
+}();
+
+// Expands 4 packed 2bpp pixels into 4 bytes, leftmost pixel first
+static constexpr auto tileExpand = []() {
+	std::array<uint32_t, 256> lut{};
+	for (int b = 0; b < 256; b++) {
+		for (int px = 0; px < 4; px++) {
+			lut[b] |= ((b >> (6 - 2 * px)) & 3) << (8 * px);
+		}
+	}
+	return lut;
+}();
+
+// Return the decoded rows of a tile, decoding it first if VRAM changed
+inline const uint16_t *Graphics::getTile(uint16_t tile)
 {
-	if (x >= GB_SCREEN_WIDTH || y >= GB_SCREEN_HEIGHT || x < 0 || y < 0) {
-		return;
+	uint64_t bit = 1ull << (tile & 63);
+	if (tilesDirty[tile >> 6] & bit) {
+		tilesDirty[tile >> 6] &= ~bit;
+
+		uint8_t *data = &vram[tile << 4];
+		for (int row = 0; row < 8; row++) {
+			tileset[tile][row] = tileInterleave[data[2 * row]] | (tileInterleave[data[2 * row + 1]] << 1);
+		}
 	}
-	
-	// rgba
-	uint32_t pixel = 0xFF000000 | 0xFF << (8 * color);
-	screenPixels[y * GB_SCREEN_WIDTH + x] = pixel;
+	return tileset[tile];
 }
 
+inline uint8_t Graphics::tilePixel(uint16_t rowBits, uint8_t col)
+{
+	return (rowBits >> (14 - 2 * col)) & 0x03;
+}
 
-inline void Graphics::setPixelColor(int x, int y, uint8_t color)
+inline void Graphics::expandTileRow(uint16_t rowBits, uint8_t *pixels)
 {
-	uint8_t palettecols[4] = {255, 192, 96, 0};
-	
-	if (x >= GB_SCREEN_WIDTH || y >= GB_SCREEN_HEIGHT || x < 0 || y < 0) {
-		return;
-	}
-	
-	// rgba
-	uint32_t pixel = 0xFF000000 | palettecols[color] << 16 | palettecols[color] << 8 | palettecols[color];
-	screenPixels[y * GB_SCREEN_WIDTH + x] = pixel;
+	uint32_t left = tileExpand[rowBits >> 8];
+	uint32_t right = tileExpand[rowBits & 0xFF];
+	memcpy(pixels, &left, 4);
+	memcpy(pixels + 4, &right, 4);
 }
 
-inline void Graphics::setDebugPixelColor(int x, int y, uint8_t color)
+inline void Graphics::setPixelColor(int x, int y, uint8_t color)
 {
-	uint8_t palettecols[4] = {255, 192, 96, 0};
-	
-	if (x >= DEBUG_WIDTH || y >= DEBUG_HEIGHT || x < 0 || y < 0) {
+	if (x >= GB_SCREEN_WIDTH || y >= GB_SCREEN_HEIGHT || x < 0 || y < 0) {
 		return;
 	}
 	
-	// rgba
-	uint32_t pixel = 0xFF000000 | palettecols[color] << 16 | palettecols[color] << 8 | palettecols[color];
-	debugTilesetPixels[y * DEBUG_WIDTH + x] = pixel;
+	// shade index, turned into RGBA when the frame is presented
+	screenPixels[y * GB_SCREEN_WIDTH + x] = color;
 }
 
 void Graphics::printDebug()
@@ -259,31 +392,264 @@ void Graphics::printDebug()
 	*/
 }
 
-void Graphics::renderDebugTileset()
+// Everything besides VRAM and OAM contents that changes how the debug views
+// look. When it changes, a view is redrawn completely.
+uint64_t Graphics::debugViewKey()
 {
-	int color;
+	uint64_t key = 0xcbf29ce484222325;
+	auto mix = [&key](const void *data, size_t len) {
+		for (size_t i = 0; i < len; i++) {
+			key = (key ^ ((const uint8_t *)data)[i]) * 0x100000001b3;
+		}
+	};
+
+	uint8_t flags = debugFlags & (Flag::TILESET | Flag::SPRITESIZE);
+	mix(&flags, sizeof(flags));
+	mix(debugBgPalette, sizeof(debugBgPalette));
+	mix(debugObjPalette, sizeof(debugObjPalette));
+	mix(emu->settings.palette, sizeof(emu->settings.palette));
+	return key;
+}
 
-	// lines of tiles
-	for (int y = 0; y < 24; ++y)
-	{
-		// columns of tiles
-		for (int x = 0; x < 16; ++x)
-		{
-			for (int i = 0; i < 8; ++i)
-			{
-				for (int j = 0; j < 8; ++j)
-				{
-					color = bgpalette[tileset[y*16 + x][i][j]];
-					setDebugPixelColor(x * 8 + j, y * 8 + i, color);
+void Graphics::invalidateDebugViews()
+{
+	memset(debugTilesWritten, 0xFF, sizeof(debugTilesWritten));
+	memset(debugMapWritten, 0xFF, sizeof(debugMapWritten));
+	debugSpritesWritten = ~0ull;
+}
+
+// Called under the state lock. Hands what the emulation wrote to every
+// view, along with the palettes and flags it is drawn with.
+void Graphics::takeDebugViewChanges()
+{
+	for (int v = 0; v < (int)DebugView::COUNT; ++v) {
+		for (int i = 0; i < 384 / 64; ++i) {
+			debugTilesDirty[v][i] |= debugTilesWritten[i];
+		}
+	}
+	for (int map = 0; map < 2; ++map) {
+		for (int i = 0; i < 1024 / 64; ++i) {
+			debugMapDirty[map][i] |= debugMapWritten[map][i];
+		}
+	}
+	debugSpritesDirty |= debugSpritesWritten;
+
+	memset(debugTilesWritten, 0x00, sizeof(debugTilesWritten));
+	memset(debugMapWritten, 0x00, sizeof(debugMapWritten));
+	debugSpritesWritten = 0;
+
+	memcpy(debugBgPalette, bgpalette, sizeof(debugBgPalette));
+	memcpy(debugObjPalette, objpalette, sizeof(debugObjPalette));
+	debugFlags = r.flags;
+}
+
+// Draw an 8x8 tile into a debug view buffer. Decodes from the copy of VRAM,
+// the tile cache belongs to the emulation.
+void Graphics::drawDebugTile(uint8_t *pixels, int width, int x, int y, const uint8_t *vramCopy, uint16_t tile,
+	const uint8_t *palette, bool xflip, bool yflip)
+{
+	const uint8_t *data = &vramCopy[tile << 4];
+	uint8_t rowPixels[8];
+
+	for (int i = 0; i < 8; ++i) {
+		int row = yflip ? 7 - i : i;
+		expandTileRow(tileInterleave[data[2 * row]] | (tileInterleave[data[2 * row + 1]] << 1), rowPixels);
+		uint8_t *dest = &pixels[(y + i) * width + x];
+		for (int j = 0; j < 8; ++j) {
+			dest[j] = palette[rowPixels[xflip ? 7 - j : j]];
+		}
+	}
+}
+
+void Graphics::uploadDebugTexture(uint32_t texture, const uint8_t *pixels, int width, int height)
+{
+	static uint32_t rgba[DEBUG_MAP_SIZE * DEBUG_MAP_SIZE];
+	shadesToRGBA(pixels, rgba, width * height, emu->settings.palette);
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+		GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Bring a debug view up to date from the GUI's copy of VRAM and OAM, after
+// the changes were taken. Called only while the view is visible, so closed
+// views cost nothing beyond setting dirty bits.
+void Graphics::renderDebugView(DebugView view, const uint8_t *vramCopy, const sprite_s *spritesCopy)
+{
+	int v = (int)view;
+	uint64_t *tilesDirty = debugTilesDirty[v];
+	bool changed = false;
+
+	// Palette or addressing changed, redraw everything
+	uint64_t key = debugViewKey();
+	if (key != debugViewKeys[v]) {
+		debugViewKeys[v] = key;
+		memset(tilesDirty, 0xFF, sizeof(debugTilesDirty[v]));
+		if (view == DebugView::TILEMAP0 or view == DebugView::TILEMAP1) {
+			memset(debugMapDirty[v - 1], 0xFF, sizeof(debugMapDirty[0]));
+		}
+		if (view == DebugView::OAM) {
+			debugSpritesDirty = ~0ull;
+		}
+	}
+
+	auto tileDirty = [tilesDirty](uint16_t tile) {
+		return (tilesDirty[tile >> 6] >> (tile & 63)) & 1;
+	};
+
+	switch (view) {
+		case DebugView::TILESET:
+			// 16x24 grid of tiles
+			for (int tile = 0; tile < 384; ++tile) {
+				if (tileDirty(tile)) {
+					drawDebugTile(debugTilesetPixels, DEBUG_WIDTH, (tile % 16) * 8, (tile / 16) * 8, vramCopy, tile, debugBgPalette);
+					changed = true;
+				}
+			}
+			break;
+
+		case DebugView::TILEMAP0:
+		case DebugView::TILEMAP1: {
+			int map = v - 1;
+			uint64_t *mapDirty = debugMapDirty[map];
+			const uint8_t *mapData = &vramCopy[map ? TILEMAP_ADDR1 : TILEMAP_ADDR0];
+
+			// Redraw entries that were written, or whose tile changed
+			for (int entry = 0; entry < 1024; ++entry) {
+				uint16_t tilenr = mapData[entry];
+				if (not (debugFlags & Flag::TILESET) and tilenr < 128) {
+					tilenr = tilenr + 256;
+				}
+
+				if (((mapDirty[entry >> 6] >> (entry & 63)) & 1) or tileDirty(tilenr)) {
+					drawDebugTile(debugMapPixels[map], DEBUG_MAP_SIZE, (entry % 32) * 8, (entry / 32) * 8, vramCopy, tilenr, debugBgPalette);
+					changed = true;
+				}
+			}
+			memset(mapDirty, 0x00, sizeof(debugMapDirty[0]));
+			break;
+		}
+
+		case DebugView::OAM: {
+			// 8x5 grid of 8x16 cells, sprites as they appear on screen
+			bool tall = debugFlags & Flag::SPRITESIZE;
+
+			for (int i = 0; i < 40; ++i) {
+				sprite_s const &sprite = spritesCopy[i];
+				uint16_t top = tall ? (sprite.tile & 0xFE) : sprite.tile;
+				uint16_t bottom = sprite.tile | 0x01;
+
+				if (not ((debugSpritesDirty >> i) & 1) and not tileDirty(top) and not (tall and tileDirty(bottom))) {
+					continue;
+				}
+
+				int x = (i % 8) * 8;
+				int y = (i / 8) * 16;
+				const uint8_t *palette = debugObjPalette[(sprite.flags & SpriteFlag::PALETTE) ? 1 : 0];
+				bool xflip = sprite.flags & SpriteFlag::XFLIP;
+				bool yflip = sprite.flags & SpriteFlag::YFLIP;
+
+				if (tall) {
+					drawDebugTile(debugOAMPixels, DEBUG_OAM_WIDTH, x, y, vramCopy, yflip ? bottom : top, palette, xflip, yflip);
+					drawDebugTile(debugOAMPixels, DEBUG_OAM_WIDTH, x, y + 8, vramCopy, yflip ? top : bottom, palette, xflip, yflip);
+				} else {
+					drawDebugTile(debugOAMPixels, DEBUG_OAM_WIDTH, x, y, vramCopy, top, palette, xflip, yflip);
+					for (int row = 8; row < 16; ++row) {
+						memset(&debugOAMPixels[(y + row) * DEBUG_OAM_WIDTH + x], 0x00, 8);
+					}
 				}
+				changed = true;
 			}
+			debugSpritesDirty = 0;
+			break;
+		}
+
+		default:
+			return;
+	}
+
+	memset(tilesDirty, 0x00, sizeof(debugTilesDirty[v]));
+
+	if (changed) {
+		switch (view) {
+			case DebugView::TILESET:
+				uploadDebugTexture(debugTexture, debugTilesetPixels, DEBUG_WIDTH, DEBUG_HEIGHT);
+				break;
+			case DebugView::TILEMAP0:
+			case DebugView::TILEMAP1:
+				uploadDebugTexture(debugMapTexture[v - 1], debugMapPixels[v - 1], DEBUG_MAP_SIZE, DEBUG_MAP_SIZE);
+				break;
+			case DebugView::OAM:
+				uploadDebugTexture(debugOAMTexture, debugOAMPixels, DEBUG_OAM_WIDTH, DEBUG_OAM_HEIGHT);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+// Fill lineSprites with the sprites to draw on the current line, ordered
+// lowest priority first, and return how many there are.
+int Graphics::selectLineSprites(uint8_t *lineSprites)
+{
+	// Like the hardware, only the first 10 sprites in OAM order are
+	// drawn on a line.
+	int spriteCnt = 0;
+	uint64_t candidates = spriteLines[r.line];
+	while (candidates and spriteCnt < SPRITES_PER_LINE) {
+		lineSprites[spriteCnt++] = std::countr_zero(candidates);
+		candidates &= candidates - 1;
+	}
+
+	// DMG priority: the sprite with the smaller X wins, ties go to the
+	// lower OAM index. Sort lowest priority first so that the winner is
+	// drawn last, on top of the others.
+	for (int i = 1; i < spriteCnt; i++) {
+		uint8_t s = lineSprites[i];
+		uint8_t sx = spritedata[s].x + 8;
+		int j = i - 1;
+		while (j >= 0 and ((uint8_t)(spritedata[lineSprites[j]].x + 8) < sx
+				or ((uint8_t)(spritedata[lineSprites[j]].x + 8) == sx and lineSprites[j] < s))) {
+			lineSprites[j + 1] = lineSprites[j];
+			j--;
 		}
+		lineSprites[j + 1] = s;
+	}
+
+	return spriteCnt;
+}
+
+// Get the 8 pixels of the tileset row a sprite contributes to the current line
+void Graphics::spriteRowPixels(sprite_s const &sprite, uint8_t spriteHeight, uint8_t *pixels)
+{
+	// determine row, flip y if wanted
+	uint8_t row = r.line - sprite.y;
+	if (sprite.flags & SpriteFlag::YFLIP) {
+		row = (spriteHeight - 1) - row;
 	}
+
+	// the upper 8x8 tile is "NN AND FEh", and the lower 8x8 tile is "NN OR 01h".
+	uint8_t spriteTile = sprite.tile;
+	if (spriteHeight == 16) {
+		spriteTile = (row < 8) ? (sprite.tile & 0xFE) : (sprite.tile | 0x01);
+	}
+
+	expandTileRow(getTile(spriteTile)[row % 8], pixels);
 }
 
 void Graphics::renderScanline()
 {
-	uint16_t yoff, xoff, tilenr;
+#ifdef GRAPHICS_SIMD_RENDERER
+	renderScanlineSpans();
+#else
+	renderScanlinePixels();
+#endif
+}
+
+void Graphics::renderScanlinePixels()
+{
+	uint16_t yoff, xoff, tilenr, rowBits;
 	uint8_t row, col, px;
 	uint8_t color;
 	uint8_t bgScanline[160];
@@ -315,12 +681,12 @@ void Graphics::renderScanline()
 		if (not (r.flags & Flag::TILESET) and tilenr < 128) {
 			tilenr = tilenr + 256;
 		}
-		
+		rowBits = getTile(tilenr)[row];
 		
 		for (int i = 0; i < 160; i++) {
-			bgScanline[i] = tileset[tilenr][row][col];
+			bgScanline[i] = tilePixel(rowBits, col);
 
-			color = bgpalette[tileset[tilenr][row][col]];
+			color = bgpalette[bgScanline[i]];
 		
 			/*
 			bit = 1 << (7 - col);
@@ -340,8 +706,15 @@ void Graphics::renderScanline()
 				if (not (r.flags & Flag::TILESET) and tilenr < 128) {
 					tilenr = tilenr + 256;
 				}
+				rowBits = getTile(tilenr)[row];
 			}
 		}
+	} else {
+		// Background disabled, line is blank
+		for (int i = 0; i < 160; i++) {
+			bgScanline[i] = 0;
+			setPixelColor(i, r.line, 0);
+		}
 	}
 
 	// Window, if enabled and on this line
@@ -370,11 +743,12 @@ void Graphics::renderScanline()
 		if (not (r.flags & Flag::TILESET) and tilenr < 128) {
 			tilenr = tilenr + 256;
 		}
+		rowBits = getTile(tilenr)[row];
 	
 		for (int i = 0; i < 160; i++) {
-			bgScanline[i] = tileset[tilenr][row][col];
+			bgScanline[i] = tilePixel(rowBits, col);
 
-			color = bgpalette[tileset[tilenr][row][col]];
+			color = bgpalette[bgScanline[i]];
 		
 			/*
 			bit = 1 << (7 - col);
@@ -394,6 +768,7 @@ void Graphics::renderScanline()
 				if (not (r.flags & Flag::TILESET) and tilenr < 128) {
 					tilenr = tilenr + 256;
 				}
+				rowBits = getTile(tilenr)[row];
 			}
 		}
 	}
@@ -403,73 +778,132 @@ void Graphics::renderScanline()
 	if (r.flags & Flag::SPRITES) {
 		uint8_t spriteHeight = (r.flags & Flag::SPRITESIZE) ? 16 : 8;
 
-		// the upper 8x8 tile is "NN AND FEh", and the lower 8x8 tile is "NN OR 01h".
+		uint8_t lineSprites[SPRITES_PER_LINE];
+		int spriteCnt = selectLineSprites(lineSprites);
 
-		for (int i = 0; i < 40; i++) {
-			// do we need to draw the sprite?
-			//printf("sprite x: %d, sprite y: %d, line: %d\n", spritedata[i].x, spritedata[i].y, r.line);
-			if (spritedata[i].y <= r.line and spritedata[i].y > r.line - spriteHeight) {
-				// determine row, flip y if wanted
-				if (spritedata[i].flags & SpriteFlag::YFLIP) {
-					row = (spriteHeight - 1) - (r.line - spritedata[i].y);
+		for (int n = 0; n < spriteCnt; n++) {
+			sprite_s const &sprite = spritedata[lineSprites[n]];
+			uint8_t spritePixels[8];
+			spriteRowPixels(sprite, spriteHeight, spritePixels);
+
+			// loop through the columns
+			for (int col = 0; col < 8; col++) {
+				if (sprite.flags & SpriteFlag::XFLIP) {
+					px = sprite.x + (7 - col);
 				} else {
-					row = r.line - spritedata[i].y;
+					px = sprite.x + col;
 				}
-				
-				// loop through the columns
-				for (int col = 0; col < 8; col++) {
-					if (spritedata[i].flags & SpriteFlag::XFLIP) {
-						px = spritedata[i].x + (7 - col);
-					} else {
-						px = spritedata[i].x + col;
-					}
-					
-					// only draw if this pixel's on the screen
-					if (px >= 0 and px < 160) {
-						uint8_t spriteTile = spritedata[i].tile;
-						uint8_t spriteRow = row;
-
-						if (spriteHeight == 16) {
-							if (row < 8) {
-								spriteTile = spritedata[i].tile & 0xFE;
-							} else {
-								spriteTile = spritedata[i].tile | 0x01;
-								spriteRow = row % 8;
-							}
+
+				// only draw if this pixel's on the screen
+				if (px < 160) {
+					color = objpalette[(sprite.flags & SpriteFlag::PALETTE) ? 1 : 0]
+							[spritePixels[col]];
+
+					// only draw sprite pixel when color is not 0
+					if (spritePixels[col] != 0) {
+
+						// Always draw if sprite priority bit is zero
+						// or if bg px is zero
+						if (not (sprite.flags & SpriteFlag::PRIORITY) or bgpalette[bgScanline[px]] == 0) {
+							setPixelColor(px, r.line, color);
 						}
+					}
+				}
+			}
+		}
+	}
+}
 
+#ifdef GRAPHICS_SIMD_RENDERER
+// Fetch one line of a 32x32 tilemap as raw 2-bit color indices, starting at
+// pixel (x, y) of the map. Whole 8-pixel tile rows are copied into a span and
+// the fine scroll is applied once, by where the span is read from.
+void Graphics::fetchMapLine(uint8_t *out, uint16_t mapAddr, uint8_t x, uint8_t y)
+{
+	uint8_t span[8 * (GB_SCREEN_WIDTH / 8 + 1)];
+	uint8_t row = y & 0x07;
+	uint16_t mapRow = mapAddr + ((y >> 3) << 5);
+	uint8_t xoff = x >> 3;
+
+	// Tile numbers are signed for the 8800-97FF tileset. Mapping 0-127 to
+	// 256-383 is the same as flipping the top bit and adding 128.
+	uint8_t tileXor = (r.flags & Flag::TILESET) ? 0x00 : 0x80;
+	uint16_t tileAdd = (r.flags & Flag::TILESET) ? 0 : 128;
+
+	for (int t = 0; t < GB_SCREEN_WIDTH / 8 + 1; t++) {
+		uint16_t tilenr = (vram[mapRow + ((xoff + t) & 0x1F)] ^ tileXor) + tileAdd;
+		expandTileRow(getTile(tilenr)[row], &span[t * 8]);
+	}
 
+	memcpy(out, &span[x & 0x07], GB_SCREEN_WIDTH);
+}
 
-						color = objpalette[(spritedata[i].flags & SpriteFlag::PALETTE) ? 1 : 0]
-								[tileset[spriteTile][spriteRow][col]];
+void Graphics::renderScanlineSpans()
+{
+	alignas(16) uint8_t bgScanline[GB_SCREEN_WIDTH];
+	alignas(16) uint8_t shades[GB_SCREEN_WIDTH];
+	__m128i bgpal = _mm_setr_epi8(bgpalette[0], bgpalette[1], bgpalette[2], bgpalette[3],
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	// The window covers the whole line when it is visible, so only one of
+	// the two maps has to be fetched.
+	if (r.flags & Flag::WINDOW and r.winx < 167 and r.winy < 144 and r.line >= (r.winy - 7)) {
+		fetchMapLine(bgScanline, (r.flags & Flag::WINDOWTILEMAP) ? TILEMAP_ADDR1 : TILEMAP_ADDR0,
+			r.winx - 7, r.line - r.winy);
+	} else if (r.flags & Flag::BG) {
+		fetchMapLine(bgScanline, (r.flags & Flag::TILEMAP) ? TILEMAP_ADDR1 : TILEMAP_ADDR0,
+			r.scx, r.line + r.scy);
+	} else {
+		// Background disabled, line is blank regardless of the palette
+		memset(bgScanline, 0x00, sizeof(bgScanline));
+		bgpal = _mm_setzero_si128();
+	}
 
-						// only draw sprite pixel when color is not 0
-						if (tileset[spriteTile][spriteRow][col] != 0) {
+	// Apply the background palette, 16 pixels per shuffle
+	for (int i = 0; i < GB_SCREEN_WIDTH; i += 16) {
+		__m128i px = _mm_load_si128((__m128i *)&bgScanline[i]);
+		_mm_store_si128((__m128i *)&shades[i], _mm_shuffle_epi8(bgpal, px));
+	}
 
-							// Always draw if sprite priority bit is zero
-							// or if bg px is zero
-							if (not (spritedata[i].flags & SpriteFlag::PRIORITY) or bgpalette[bgScanline[px]] == 0) {
-								setPixelColor(px, r.line, color);
-							}
-						}
-					}
+	// Sprites
+	if (r.flags & Flag::SPRITES) {
+		uint8_t spriteHeight = (r.flags & Flag::SPRITESIZE) ? 16 : 8;
+		uint8_t lineSprites[SPRITES_PER_LINE];
+		int spriteCnt = selectLineSprites(lineSprites);
+
+		for (int n = 0; n < spriteCnt; n++) {
+			sprite_s const &sprite = spritedata[lineSprites[n]];
+			uint8_t spritePixels[8];
+			spriteRowPixels(sprite, spriteHeight, spritePixels);
+			const uint8_t *palette = objpalette[(sprite.flags & SpriteFlag::PALETTE) ? 1 : 0];
+
+			for (int col = 0; col < 8; col++) {
+				uint8_t px = sprite.x + ((sprite.flags & SpriteFlag::XFLIP) ? (7 - col) : col);
+				if (px < GB_SCREEN_WIDTH and spritePixels[col] != 0
+						and (not (sprite.flags & SpriteFlag::PRIORITY) or bgpalette[bgScanline[px]] == 0)) {
+					shades[px] = palette[spritePixels[col]];
 				}
 			}
 		}
 	}
+
+	// Write the finished line out once
+	memcpy(&screenPixels[r.line * GB_SCREEN_WIDTH], shades, GB_SCREEN_WIDTH);
 }
+#endif
 
+// VRAM writes only mark the tile they touch, decoding is deferred until the
+// tile is sampled. Tilemap writes don't affect the tileset at all.
 void Graphics::updateTile(uint8_t b, uint16_t addr)
 {
-	int tile = (addr >> 4) & 0x1FF;
-	int row = (addr >> 1) & 0x07;
-	
-	//printf("updateTile! tile=%d, row=%d.\n", tile, row);
-	
-	for (int col = 0; col < 8; col++) {
-		int bit = 1 << (7 - col);
-		tileset[tile][row][col] = ((vram[addr] & bit) ? 1 : 0);
-		tileset[tile][row][col] |= ((vram[addr+1] & bit) ? 2 : 0);
+	if (addr < 0x1800) {
+		int tile = addr >> 4;
+		uint64_t bit = 1ull << (tile & 63);
+		tilesDirty[tile >> 6] |= bit;
+		debugTilesWritten[tile >> 6] |= bit;
+	} else {
+		int entry = addr & 0x3FF;
+		debugMapWritten[(addr - 0x1800) >> 10][entry >> 6] |= 1ull << (entry & 63);
 	}
 }
 
@@ -478,9 +912,13 @@ void Graphics::buildSpriteData(uint8_t b, uint16_t addr)
 	uint16_t spriteNum = addr >> 2;
 	
 	if (spriteNum < 40) { // Only 40 sprites
+		debugSpritesWritten |= 1ull << spriteNum;
+
 		switch (addr & 0x03) {
 			case 0: // Y-coord
+				updateSpriteLines(spriteNum, false);
 				spritedata[spriteNum].y = b - 16;
+				updateSpriteLines(spriteNum, true);
 				//printf("Sprite #%d to Y of %d.\n", spriteNum, b-16);
 				break;
 				
@@ -500,6 +938,33 @@ void Graphics::buildSpriteData(uint8_t b, uint16_t addr)
 	}
 }
 
+// Add or remove a sprite from the per-line lists for all lines it covers
+void Graphics::updateSpriteLines(uint8_t spriteNum, bool visible)
+{
+	int spriteHeight = (r.flags & Flag::SPRITESIZE) ? 16 : 8;
+
+	// OAM Y is stored minus 16, so a raw Y below 16 wraps around
+	int top = (uint8_t)(spritedata[spriteNum].y + 16) - 16;
+	int bottom = top + spriteHeight;
+	uint64_t bit = 1ull << spriteNum;
+
+	for (int line = (top < 0 ? 0 : top); line < bottom and line < GB_SCREEN_HEIGHT; line++) {
+		if (visible) {
+			spriteLines[line] |= bit;
+		} else {
+			spriteLines[line] &= ~bit;
+		}
+	}
+}
+
+void Graphics::rebuildSpriteLines()
+{
+	memset(spriteLines, 0x00, sizeof(spriteLines));
+	for (int i = 0; i < 40; i++) {
+		updateSpriteLines(i, true);
+	}
+}
+
 
 void Graphics::renderFrame()
 {
@@ -508,9 +973,24 @@ void Graphics::renderFrame()
 	//SDL_GetWindowSize(mainWindow, &w, &h);
 	//SDL_GL_GetDrawableSize(mainWindow, &display_w, &display_h);
 
-	emu->gui.render();
+	Perf::sample_t &sample = emu->perf.display.current;
+	{
+		Perf::Timer timer(sample, Perf::PRESENT);
+		updateTextures();
+	}
+	{
+		Perf::Timer timer(sample, Perf::GUI);
+		{
+			// Only copying holds up the emulation. Redrawing the debug views,
+			// decoding RAM and building the windows happen after.
+			std::lock_guard<std::mutex> lock(emu->stateMutex);
+			emu->gui.takeSnapshot();
+		}
+		emu->gui.refreshViews();
+		emu->gui.render();
+	}
 
-	
+	Perf::Timer timer(sample, Perf::PRESENT);
 	glViewport(0, 0, (int)ImGui::GetIO().DisplaySize.x, (int)ImGui::GetIO().DisplaySize.y);
 	ImVec4 clear_color = ImColor(128, 128, 128, 128);
 	glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
@@ -557,7 +1037,12 @@ void Graphics::step()
 						emu->cpu.intFlags |= CPU::Int::LCDSTAT;
 					}
 
-					updateTextures();
+					// Hand the finished frame to the present stage
+					if (not skippingFrame) {
+						Perf::Timer timer(emu->perf.emulation.current, Perf::PPU);
+						memcpy(emu->frames.writeBuffer().pixels, screenPixels, sizeof(screenPixels));
+						emu->frames.publish();
+					}
 				}
 				else {
 					mode = Mode::OAM;
@@ -578,6 +1063,9 @@ void Graphics::step()
 					mode = Mode::OAM;
 					r.line = 0;
 
+					// Decide per whole frame, so frames are never partially drawn
+					skippingFrame = skipRequested;
+
 					if (OAMInt) {
 						emu->cpu.intFlags |= CPU::Int::LCDSTAT;
 					}
@@ -596,7 +1084,10 @@ void Graphics::step()
 			if (mclock >= 43) {
 				mclock = 0;
 				mode = Mode::HBLANK;
-				renderScanline();
+				if (not skippingFrame) {
+					Perf::Timer timer(emu->perf.emulation.current, Perf::PPU);
+					renderScanline();
+				}
 
 				if (hBlankInt) {
 					emu->cpu.intFlags |= CPU::Int::LCDSTAT;
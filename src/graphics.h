@@ -1,6 +1,7 @@
 #ifndef INCLUDED_GRAPHICS_H
 #define INCLUDED_GRAPHICS_H
 
+#include <cstddef>
 #include <cstdint>
 struct Dromaius;
 
@@ -10,6 +11,12 @@ struct Dromaius;
 #define DEBUG_WIDTH   (8*16)
 #define DEBUG_HEIGHT  (8*24)
 
+#define DEBUG_MAP_SIZE    (8*32)
+#define DEBUG_OAM_WIDTH   (8*8)
+#define DEBUG_OAM_HEIGHT  (16*5)
+
+#define SPRITES_PER_LINE 10
+
 //#define WINDOW_SCALE  2
 
 struct Graphics
@@ -41,6 +48,14 @@ struct Graphics
 		PRIORITY = 0x80
 	};
 
+	enum class DebugView {
+		TILESET,
+		TILEMAP0,
+		TILEMAP1,
+		OAM,
+		COUNT
+	};
+
 	struct regs_s {
 		uint8_t flags;
 		uint8_t line;
@@ -61,15 +76,15 @@ struct Graphics
 	// Up-reference
 	Dromaius *emu;
 
-	unsigned int screenScale;
-
 	// Buffers and such
 	uint8_t vram[0x2000];
 	uint8_t oam[0xA0];
-	uint8_t tileset[0x200][8][8];
+	uint16_t tileset[384][8]; // decoded rows, 2 bits per pixel, leftmost pixel on top
+	uint64_t tilesDirty[384 / 64]; // tiles whose VRAM changed since they were decoded
 	uint8_t bgpalette[4];
 	uint8_t objpalette[2][4];
 	sprite_s spritedata[0x28]; // 40 sprites
+	uint64_t spriteLines[GB_SCREEN_HEIGHT]; // per line, bit i set if sprite i overlaps it
 
 	// State
 	regs_s r;
@@ -82,27 +97,70 @@ struct Graphics
 
 	// Window stuff
 	uint32_t screenTexture;
+	uint32_t screenPBO[2]; // alternated between frames so uploads don't stall
+	uint8_t screenPBOIndex;
+	uint8_t screenPixels[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT]; // shade indices (0-3)
+	uint64_t uploadedFrameHash;
+	bool skipRequested; // set by the frontend, applies from the next frame on
+	bool skippingFrame; // current frame keeps timing but draws no pixels
+
+	// VRAM debug views, only redrawn where VRAM changed and while visible.
+	// The emulation marks what it writes. The GUI takes the marks and the
+	// palettes over under the state lock, then draws without holding it.
+	uint64_t debugTilesWritten[384 / 64];
+	uint64_t debugMapWritten[2][1024 / 64];
+	uint64_t debugSpritesWritten;
+
+	// GUI side of the debug views
 	uint32_t debugTexture;
-	uint32_t screenPixels[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT];
-	uint32_t debugTilesetPixels[DEBUG_WIDTH * DEBUG_HEIGHT];
+	uint32_t debugMapTexture[2];
+	uint32_t debugOAMTexture;
+	uint8_t debugTilesetPixels[DEBUG_WIDTH * DEBUG_HEIGHT];
+	uint8_t debugMapPixels[2][DEBUG_MAP_SIZE * DEBUG_MAP_SIZE];
+	uint8_t debugOAMPixels[DEBUG_OAM_WIDTH * DEBUG_OAM_HEIGHT];
+	uint64_t debugTilesDirty[(int)DebugView::COUNT][384 / 64]; // per view
+	uint64_t debugMapDirty[2][1024 / 64]; // tilemap entries written
+	uint64_t debugSpritesDirty; // OAM entries written
+	uint8_t debugBgPalette[4];
+	uint8_t debugObjPalette[2][4];
+	uint8_t debugFlags;
+	uint64_t debugViewKeys[(int)DebugView::COUNT]; // palettes/flags last drawn with
 
 	bool initialized = false;
 
 	void initialize();
 	void initDisplay();
 	void updateTextures();
+	uint64_t frameHash(const uint8_t *pixels);
+	static void shadesToRGBA(const uint8_t *shades, uint32_t *out, size_t len, const uint32_t *palette);
 
 	uint8_t readByte(uint16_t addr);
 	void writeByte(uint8_t b, uint16_t addr);
 
 	void setPixelColor(int x, int y, uint8_t color);
-	void setPixelColorDebug(int x, int y, uint8_t color);
-	void setDebugPixelColor(int x, int y, uint8_t color);
 	void printDebug();
-	void renderDebugTileset();
+	void takeDebugViewChanges();
+	void renderDebugView(DebugView view, const uint8_t *vramCopy, const sprite_s *spritesCopy);
+	void invalidateDebugViews();
+	uint64_t debugViewKey();
+	void drawDebugTile(uint8_t *pixels, int width, int x, int y, const uint8_t *vramCopy, uint16_t tile,
+		const uint8_t *palette, bool xflip = false, bool yflip = false);
+	void uploadDebugTexture(uint32_t texture, const uint8_t *pixels, int width, int height);
 	void renderScanline();
+	void renderScanlinePixels();
+#ifdef GRAPHICS_SIMD_RENDERER
+	void renderScanlineSpans();
+	void fetchMapLine(uint8_t *out, uint16_t mapAddr, uint8_t x, uint8_t y);
+#endif
+	int selectLineSprites(uint8_t *lineSprites);
+	void spriteRowPixels(sprite_s const &sprite, uint8_t spriteHeight, uint8_t *pixels);
 	void updateTile(uint8_t b, uint16_t addr);
+	const uint16_t *getTile(uint16_t tile);
+	static uint8_t tilePixel(uint16_t rowBits, uint8_t col);
+	static void expandTileRow(uint16_t rowBits, uint8_t *pixels);
 	void buildSpriteData(uint8_t b, uint16_t addr);
+	void updateSpriteLines(uint8_t spriteNum, bool visible);
+	void rebuildSpriteLines();
 	void renderFrame();
 	void renderGUI();
 	const char *modeToString(uint8_t mode);
@@ -3,18 +3,28 @@
 #include <cstdint>
 #include <cstdarg>
 #include <iostream>
+#include <bit>
+#include <algorithm>
 
 #include "dromaius.h"
 
 #define GUI_INDENT_WIDTH 16.0f
 
-// Constructor builds the window
+// Constructor only initializes SDL, so the emulator also runs headless
 GUI::GUI() {
-	// Try to initialize SDL.
-	if (SDL_Init(SDL_INIT_EVERYTHING) == -1) {
+	// Try to initialize SDL, video comes with the window
+	if (SDL_Init(SDL_INIT_EVERYTHING & ~SDL_INIT_VIDEO) == -1) {
 		std::cerr << "Failed to initialize SDL.\n";
 		exit(1);
 	}
+}
+
+// Called once from the GUI thread, builds the window
+void GUI::initDisplay() {
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) == -1) {
+		std::cerr << "Failed to initialize SDL video.\n";
+		exit(1);
+	}
 
 	// Setup window
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
@@ -78,16 +88,18 @@ GUI::GUI() {
 	// Setup ImGui
 	initializeImgui();
 
-	// Disable vsync, we do our own syncing
-	SDL_GL_SetSwapInterval(0);
+	// The GUI renders at display refresh, emulation paces itself
+	vsync = SDL_GL_SetSwapInterval(1) == 0;
 
 	// filtering
 	//SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
 }
 
 GUI::~GUI() {
-	ImGui_ImplSDL2_Shutdown();
-	ImGui::DestroyContext();
+	if (window) {
+		ImGui_ImplSDL2_Shutdown();
+		ImGui::DestroyContext();
+	}
 	//SDL_GL_DeleteContext(glcontext);
 	//SDL_DestroyWindow(window);
 	SDL_Quit();
@@ -105,6 +117,112 @@ void GUI::initializeImgui() {
 }
 
 
+// Copy what the windows show, called between two emulated frames
+void GUI::takeSnapshot()
+{
+	Memory &memory = emu->memory;
+	snapshot.romLoaded = memory.romLoaded;
+	snapshot.biosLoaded = memory.biosLoaded;
+	snapshot.speed = emu->speed;
+	snapshot.settings = emu->settings;
+	emu->perf.summarize(emu->perf.emulation, snapshot.emulation);
+	if (not memory.romLoaded) {
+		return;
+	}
+
+	auto romheader = (Memory::romheader_t *)(memory.rom + 0x134);
+	snprintf(snapshot.gameName, sizeof(snapshot.gameName), "%.15s", romheader->gamename);
+	snprintf(snapshot.romInfo, sizeof(snapshot.romInfo),
+		"ROM Name: %s\nMBC: %s\nCountry: %s\nType: %s\nROM size: %s\nRAM size: %s",
+		snapshot.gameName,
+		memory.mbcAsString().c_str(),
+		romheader->country ? "Other" : "Japan",
+		memory.getCartridgeTypeString(romheader->type).c_str(),
+		memory.getCartridgeRomSizeString(romheader->romsize).c_str(),
+		memory.getCartridgeRomSizeString(romheader->ramsize).c_str()
+	);
+	snapshot.romBank = emu->symbols.currentBank(0x4000);
+	snapshot.ramBank = emu->symbols.currentBank(0xA000);
+	memcpy(snapshot.workram, memory.workram, sizeof(snapshot.workram));
+
+	snapshot.cpu = emu->cpu;
+
+	Graphics &graphics = emu->graphics;
+	snapshot.r = graphics.r;
+	snapshot.mode = graphics.mode;
+	memcpy(snapshot.spritedata, graphics.spritedata, sizeof(snapshot.spritedata));
+	memcpy(snapshot.vram, graphics.vram, sizeof(snapshot.vram));
+
+	Audio &audio = emu->audio;
+	snapshot.audioEnabled = audio.isEnabled;
+	snapshot.channelEnabled[0] = audio.ch1.isEnabled;
+	snapshot.channelEnabled[1] = audio.ch2.isEnabled;
+	snapshot.channelEnabled[2] = audio.ch3.isEnabled;
+	snapshot.channelEnabled[3] = audio.ch4.isEnabled;
+	memcpy(snapshot.waveRam, audio.waveRam, sizeof(snapshot.waveRam));
+	snapshot.queueFill = audio.queueFill;
+	snapshot.rateAdjust = audio.rateAdjust;
+	snapshot.audioDev = audio.dev;
+
+	Profiler &profiler = emu->profiler;
+	snapshot.depth = profiler.depth;
+	snapshot.resyncs = profiler.resyncs;
+	memcpy(snapshot.stack, profiler.stack, profiler.depth * sizeof(Profiler::frame_t));
+	if (profileShown) {
+		snapshot.functions = profiler.functions;
+		snapshot.edges = profiler.edges;
+	}
+
+	// Whatever is drawn from the state, for the windows that were open
+	if (debugViewsShown) {
+		graphics.takeDebugViewChanges();
+	}
+	if (memoryViewShown) {
+		memory.peekRange(0x0000, 0x10000, memoryViewBank, memoryViewBuffer);
+	}
+	if (disasmShown) {
+		emu->disassembly.takeRamChanges();
+	}
+}
+
+// Redraw the debug views and redecode RAM from what takeSnapshot copied,
+// after the state lock is released
+void GUI::refreshViews()
+{
+	if (not snapshot.romLoaded) {
+		return;
+	}
+
+	for (int view = 0; view < (int)Graphics::DebugView::COUNT; view++) {
+		if (debugViewsShown & (1 << view)) {
+			emu->graphics.renderDebugView((Graphics::DebugView)view, snapshot.vram, snapshot.spritedata);
+		}
+	}
+	if (disasmShown) {
+		emu->disassembly.refreshRam();
+	}
+}
+
+// Ask the emulation thread for a change, it applies it before the next frame
+void GUI::send(uint8_t type, int value, uint16_t addr)
+{
+	if (not emu->commandQueue.push({type, addr, value})) {
+		printf("Command queue full, dropping command\n");
+	}
+}
+
+// Bank that was mapped at the address when the snapshot was taken
+uint8_t GUI::currentBank(uint16_t addr)
+{
+	if (addr >= 0x4000 and addr < 0x8000) {
+		return snapshot.romBank;
+	}
+	if (addr >= 0xA000 and addr < 0xC000) {
+		return snapshot.ramBank;
+	}
+	return 0;
+}
+
 void GUI::renderHoverText(const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -119,43 +237,154 @@ void GUI::renderHoverText(const char *fmt, ...) {
 	va_end(args);
 }
 
+// Search box with the matches listed below it while typing. Searches again
+// on every change. Returns the symbol picked by click or enter, if any.
+const Symbols::symbol_t *GUI::renderSymbolSearch(const char *id, symbolSearch_t &search)
+{
+	Symbols &symbols = emu->symbols;
+	const Symbols::symbol_t *picked = nullptr;
+
+	ImGui::SetNextItemWidth(200);
+	bool enter = ImGui::InputTextWithHint(id, "symbol", search.query, sizeof(search.query),
+		ImGuiInputTextFlags_EnterReturnsTrue);
+
+	if (strcmp(search.query, search.lastQuery) != 0 or search.symbolCount != symbols.size()) {
+		strcpy(search.lastQuery, search.query);
+		search.symbolCount = symbols.size();
+		search.resultCount = symbols.search(search.query, search.results, GUI_SEARCH_RESULTS);
+	}
+
+	if (enter and search.resultCount > 0) {
+		picked = &symbols.byName[search.results[0]];
+	}
+	for (size_t i = 0; i < search.resultCount and search.query[0]; i++) {
+		Symbols::symbol_t const &symbol = symbols.byName[search.results[i]];
+		char label[96];
+		snprintf(label, sizeof(label), "%02X:%04X %.*s##%s%zu", symbol.bank, symbol.addr,
+			(int)symbol.name.size(), symbol.name.data(), id, i);
+		if (ImGui::Selectable(label)) {
+			picked = &symbol;
+		}
+	}
+
+	if (picked) {
+		search.query[0] = '\0';
+	}
+	return picked;
+}
+
 void GUI::renderInfoWindow() {
 	ImGui::Begin("Info", nullptr);
 
-	if (emu->memory.romLoaded) {
-		auto romheader = (Memory::romheader_t *)(emu->memory.rom + 0x134); 
+	if (snapshot.romLoaded) {
 		ImGui::Text("ROM: %s", emu->filename.c_str());
-		ImGui::Text("ROM Name: %s\nMBC: %s\nCountry: %s\nType: %s\nROM size: %s\nRAM size: %s",
-			romheader->gamename,
-			emu->memory.mbcAsString().c_str(),
-			romheader->country ? "Other" : "Japan",
-			emu->memory.getCartridgeTypeString(romheader->type).c_str(),
-			emu->memory.getCartridgeRomSizeString(romheader->romsize).c_str(),
-			emu->memory.getCartridgeRomSizeString(romheader->ramsize).c_str()
-		);
+		ImGui::TextUnformatted(snapshot.romInfo);
 	} else {
 		ImGui::Text("No ROM loaded");
 		if (ImGui::Button("Load ROM...")) {
 			triggerRomLoadDialog();
 		}
 	}
+
+	if (ImGui::CollapsingHeader("Performance", ImGuiTreeNodeFlags_DefaultOpen)) {
+		renderPerformance();
+	}
 	ImGui::End(); // info window
 }
 
+// Rates and host time per stage, averaged over the last few seconds
+void GUI::renderPerformance()
+{
+	Perf &perf = emu->perf;
+	Perf::summary_t const &emulation = snapshot.emulation;
+	Perf::summary_t display;
+	perf.summarize(perf.display, display);
+
+	ImGui::Checkbox("Overlay", &showPerfOverlay);
+	ImGui::Text("Speed: %.1f%%, %.1f frames/s, %.1f GUI frames/s", emulation.speed * 100.0, emulation.fps, display.fps);
+	ImGui::Text("%.2f M instructions/s, %.0f cycles/frame", emulation.instructionsPerSecond / 1e6, emulation.cyclesPerFrame);
+	ImGui::Text("Frame: %.2f ms busy of %.2f ms", emulation.busyMs, emulation.frameMs);
+	ImGui::Text("Busy percentiles: 50th %.2f, 90th %.2f, 99th %.2f, max %.2f ms",
+		emulation.busyPercentile[0], emulation.busyPercentile[1], emulation.busyPercentile[2], emulation.busyPercentile[3]);
+
+	if (not ImGui::BeginTable("perf", 3, ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_RowBg)) {
+		return;
+	}
+	ImGui::TableSetupColumn("stage");
+	ImGui::TableSetupColumn("ms/frame");
+	ImGui::TableSetupColumn("share");
+	ImGui::TableHeadersRow();
+
+	// Emulation stages per emulated frame, GUI stages per displayed frame
+	auto row = [](const char *name, double ms, double frameMs) {
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(name);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", ms);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.1f%%", frameMs > 0 ? 100.0 * ms / frameMs : 0.0);
+	};
+	Perf::summary_t const *threads[] = {&emulation, &display};
+	static const char *other[] = {"Other (emulation)", "Other (GUI)"};
+	for (int thread = 0; thread < 2; thread++) {
+		Perf::summary_t const &summary = *threads[thread];
+		double rest = summary.frameMs;
+		for (int stage = 0; stage < Perf::STAGE_COUNT; stage++) {
+			bool emulationStage = stage == Perf::CPU or stage == Perf::PPU or stage == Perf::APU;
+			bool guiStage = stage == Perf::GUI or stage == Perf::PRESENT;
+			if (thread == 0 ? guiStage : emulationStage) {
+				continue;
+			}
+			char name[32];
+			snprintf(name, sizeof(name), stage == Perf::SLEEP ? "%s (%s)" : "%s",
+				Perf::stageName(stage), thread == 0 ? "emulation" : "GUI");
+			row(name, summary.stageMs[stage], summary.frameMs);
+			rest -= summary.stageMs[stage];
+		}
+		row(other[thread], std::max(rest, 0.0), summary.frameMs);
+	}
+	ImGui::EndTable();
+}
+
+// Speed and frame time in a corner, on top of everything
+void GUI::renderPerfOverlay()
+{
+	Perf::summary_t const &summary = snapshot.emulation;
+
+	ImGuiViewport *viewport = ImGui::GetMainViewport();
+	ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x - 10.0f, viewport->WorkPos.y + 10.0f),
+		ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+	ImGui::SetNextWindowBgAlpha(0.5f);
+	ImGui::Begin("Performance overlay", nullptr,
+		ImGuiWindowFlags_NoDecoration |
+		ImGuiWindowFlags_NoDocking |
+		ImGuiWindowFlags_AlwaysAutoResize |
+		ImGuiWindowFlags_NoSavedSettings |
+		ImGuiWindowFlags_NoFocusOnAppearing |
+		ImGuiWindowFlags_NoNav
+	);
+	ImGui::Text("%.0f%% speed, %.1f fps", summary.speed * 100.0, summary.fps);
+	ImGui::Text("%.2f ms busy, 99th %.2f ms", summary.busyMs, summary.busyPercentile[2]);
+	ImGui::Text("CPU %.2f  PPU %.2f  APU %.2f ms", summary.stageMs[Perf::CPU], summary.stageMs[Perf::PPU],
+		summary.stageMs[Perf::APU]);
+	ImGui::End();
+}
+
 
 void GUI::renderSettingsWindow() {
 	ImGui::Begin("Controls", nullptr);
 
-	if (emu->memory.romLoaded) {
+	if (snapshot.romLoaded) {
 		float fps = ImGui::GetIO().Framerate;
-		ImGui::Text("FPS: %.1f (%.1fx speed)", fps, fps / 61.0f);
+		ImGui::Text("FPS: %.1f (%.0f%% speed)", fps, snapshot.speed * 100.0f);
 		
 		if (ImGui::Button("Reset ROM")) {
-			emu->reset();
+			send(Dromaius::RESET);
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("Unload ROM")) {
-			emu->unloadRom();
+			send(Dromaius::UNLOAD_ROM);
 		}
 
 		ImGui::Separator();
@@ -167,6 +396,7 @@ void GUI::renderSettingsWindow() {
 			if (i > 0)
 				ImGui::SameLine();
 			if (ImGui::SmallButton(std::to_string(i).c_str())) {
+				std::lock_guard<std::mutex> lock(emu->stateMutex);
 				emu->saveState(i);
 			}
 
@@ -181,6 +411,9 @@ void GUI::renderSettingsWindow() {
 			if (i > 0)
 				ImGui::SameLine();
 			if (ImGui::SmallButton(std::to_string(i).c_str())) {
+				// Here rather than on the emulation thread, the GL objects
+				// in the state are ours
+				std::lock_guard<std::mutex> lock(emu->stateMutex);
 				emu->loadState(i);
 			}
 
@@ -190,18 +423,34 @@ void GUI::renderSettingsWindow() {
 		ImGui::Separator();
 
 		if (ImGui::Button("Dump memory to \nfile (memdump.bin)")) {
-			emu->memory.dumpToFile("memdump.bin");
+			send(Dromaius::DUMP_MEMORY);
 		}
 		
 		ImGui::Separator();
 
-		ImGui::Checkbox("Fast forward", &emu->cpu.fastForward);
-		ImGui::Checkbox("Step mode", &emu->cpu.stepMode);
+		settings_t &settings = snapshot.settings;
+		if (ImGui::Checkbox("Turbo (tab)", &snapshot.cpu.fastForward)) {
+			send(Dromaius::SET_TURBO, snapshot.cpu.fastForward);
+		}
+		ImGui::SameLine();
+		int turbo = settings.turboSpeed == 0 ? 3 : std::countr_zero((unsigned)settings.turboSpeed) - 1;
+		ImGui::SetNextItemWidth(80);
+		if (ImGui::Combo("##turbo", &turbo, "2x\0" "4x\0" "8x\0Uncapped\0")) {
+			settings.turboSpeed = turbo == 3 ? 0 : 2 << turbo;
+			settingsChanged = true;
+		}
+		settingsChanged |= ImGui::Checkbox("Mute during turbo", &settings.turboMute);
+		settingsChanged |= ImGui::Checkbox("Sync to audio clock", &settings.audioSync);
+		ImGui::SetNextItemWidth(80);
+		settingsChanged |= ImGui::Combo("Frame skip", &settings.frameSkip, "Auto\0None\0" "1 of 2\0" "1 of 3\0" "1 of 4\0" "1 of 5\0" "1 of 6\0");
+		if (ImGui::Checkbox("Step mode", &snapshot.cpu.stepMode)) {
+			send(Dromaius::SET_STEP_MODE, snapshot.cpu.stepMode);
+		}
 		if (ImGui::Button("Step instruction (space)")) {
-			emu->cpu.stepInst = true;
+			send(Dromaius::STEP_INSTRUCTION);
 		}
 		if (ImGui::Button("Step frame (f)")) {
-			emu->cpu.stepFrame = true;
+			send(Dromaius::STEP_FRAME);
 		}
 	}
 	ImGui::End();
@@ -211,33 +460,33 @@ void GUI::renderSettingsWindow() {
 void GUI::renderCPUDebugWindow() {
 	ImGui::Begin("CPU", nullptr);
 
-	if (emu->memory.romLoaded) {
-		ImGui::Text("cycle: %d", emu->cpu.c);
+	if (snapshot.romLoaded) {
+		ImGui::Text("cycle: %d", snapshot.cpu.c);
 
 		ImGui::Separator();
 
-		ImGui::Text("interrupts: %s (enabled / flagged):", emu->cpu.intsOn ? "on " : "off");
+		ImGui::Text("interrupts: %s (enabled / flagged):", snapshot.cpu.intsOn ? "on " : "off");
 		ImGui::Text("     VBLANK: %s / %s",
-			emu->cpu.ints & CPU::Int::VBLANK ? "yes" : "no ",
-			emu->cpu.intFlags & CPU::Int::VBLANK ? "yes" : "no ");
+			snapshot.cpu.ints & CPU::Int::VBLANK ? "yes" : "no ",
+			snapshot.cpu.intFlags & CPU::Int::VBLANK ? "yes" : "no ");
 		ImGui::Text("    LCDSTAT: %s / %s",
-			emu->cpu.ints & CPU::Int::LCDSTAT ? "yes" : "no ",
-			emu->cpu.intFlags & CPU::Int::LCDSTAT ? "yes" : "no ");
+			snapshot.cpu.ints & CPU::Int::LCDSTAT ? "yes" : "no ",
+			snapshot.cpu.intFlags & CPU::Int::LCDSTAT ? "yes" : "no ");
 		ImGui::Text("      TIMER: %s / %s",
-			emu->cpu.ints & CPU::Int::TIMER ? "yes" : "no ",
-			emu->cpu.intFlags & CPU::Int::TIMER ? "yes" : "no ");
+			snapshot.cpu.ints & CPU::Int::TIMER ? "yes" : "no ",
+			snapshot.cpu.intFlags & CPU::Int::TIMER ? "yes" : "no ");
 		ImGui::Text("     SERIAL: %s / %s",
-			emu->cpu.ints & CPU::Int::SERIAL ? "yes" : "no ",
-			emu->cpu.intFlags & CPU::Int::SERIAL ? "yes" : "no ");
+			snapshot.cpu.ints & CPU::Int::SERIAL ? "yes" : "no ",
+			snapshot.cpu.intFlags & CPU::Int::SERIAL ? "yes" : "no ");
 		ImGui::Text("     JOYPAD: %s / %s",
-			emu->cpu.ints & CPU::Int::JOYPAD ? "yes" : "no ",
-			emu->cpu.intFlags & CPU::Int::JOYPAD ? "yes" : "no ");
+			snapshot.cpu.ints & CPU::Int::JOYPAD ? "yes" : "no ",
+			snapshot.cpu.intFlags & CPU::Int::JOYPAD ? "yes" : "no ");
 
 		ImGui::Separator();
 
-		ImGui::Text("timer: %s", emu->cpu.timer.tac & 0x04 ? "started" : "stopped");
-		ImGui::Text("      tac: %02X    tma: %02X", emu->cpu.timer.tac, emu->cpu.timer.tma);
-		ImGui::Text("     tima: %02X    div: %02X", emu->cpu.timer.tima, emu->cpu.timer.div);
+		ImGui::Text("timer: %s", snapshot.cpu.timer.tac & 0x04 ? "started" : "stopped");
+		ImGui::Text("      tac: %02X    tma: %02X", snapshot.cpu.timer.tac, snapshot.cpu.timer.tma);
+		ImGui::Text("     tima: %02X    div: %02X", snapshot.cpu.timer.tima, snapshot.cpu.timer.div);
 
 
 
@@ -249,93 +498,316 @@ void GUI::renderCPUDebugWindow() {
 					"d: %02X       sp: %04X\n"
 					"e: %02X   \n"
 					"f: %c,%c,%c,%c",
-				emu->cpu.r.a, (emu->cpu.r.h << 8) | emu->cpu.r.l, emu->cpu.r.b, emu->cpu.r.c,
-				emu->cpu.r.pc, emu->cpu.r.d, emu->cpu.r.sp, emu->cpu.r.e,
-				emu->cpu.getFlag(CPU::Flag::ZERO) ? 'Z' : '_',
-				emu->cpu.getFlag(CPU::Flag::SUBTRACT) ? 'N' : '_',
-				emu->cpu.getFlag(CPU::Flag::HCARRY) ? 'H' : '_',
-				emu->cpu.getFlag(CPU::Flag::CARRY) ? 'C' : '_'
+				snapshot.cpu.r.a, (snapshot.cpu.r.h << 8) | snapshot.cpu.r.l, snapshot.cpu.r.b, snapshot.cpu.r.c,
+				snapshot.cpu.r.pc, snapshot.cpu.r.d, snapshot.cpu.r.sp, snapshot.cpu.r.e,
+				snapshot.cpu.getFlag(CPU::Flag::ZERO) ? 'Z' : '_',
+				snapshot.cpu.getFlag(CPU::Flag::SUBTRACT) ? 'N' : '_',
+				snapshot.cpu.getFlag(CPU::Flag::HCARRY) ? 'H' : '_',
+				snapshot.cpu.getFlag(CPU::Flag::CARRY) ? 'C' : '_'
 			);
 		}
 
 
-		if (ImGui::CollapsingHeader("Disassembly @ PC", ImGuiTreeNodeFlags_DefaultOpen)) {
-			char buf[25 * 20];
-			buf[0] = '\0';
-			emu->cpu.disassemble(emu->cpu.r.pc, 20, buf);
-			ImGui::Text("%s", buf);
+		if (ImGui::CollapsingHeader("Disassembly", ImGuiTreeNodeFlags_DefaultOpen)) {
+			renderDisassembly();
 		}
 
 		if (ImGui::CollapsingHeader("Call stack", ImGuiTreeNodeFlags_DefaultOpen)) {
-			ImGui::Text("depth: %d", emu->cpu.callStackDepth);
-			for (int i = 0; i < emu->cpu.callStackDepth; ++i) {
-				std::string symbol = emu->memory.getSymbolFromAddress(emu->memory.romBank, emu->cpu.callStack[i]);
-				if (symbol != "") {
-					ImGui::Text("%d: %04X (%s)", i, emu->cpu.callStack[i], symbol.c_str());
+			ImGui::Text("depth: %d  resyncs: %llu", snapshot.depth, (unsigned long long)snapshot.resyncs);
+			for (int i = snapshot.depth - 1; i >= 0; --i) {
+				Profiler::frame_t const &frame = snapshot.stack[i];
+				static const char *kinds[] = {"entry", "call", "rst", "int"};
+				char symbol[64];
+				emu->symbols.format(symbol, sizeof(symbol), frame.bank, frame.target);
+				ImGui::Text("%d: %02X:%04X %s", i, frame.bank, frame.target, symbol);
+				renderHoverText("%s from %04X, return address at %04X\n%llu cycles ago", kinds[frame.kind],
+					frame.site, frame.sp, snapshot.cpu.c - frame.entry);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Profile")) {
+			renderProfile();
+		}
+	}
+
+	ImGui::End();
+}
+
+// Functions taking the most time in the last frame, with their callers and
+// callees on hover
+void GUI::renderProfile()
+{
+	std::vector<Profiler::function_t> const &functions = snapshot.functions;
+	profileShown = true;
+
+	if (ImGui::Button("Reset")) {
+		send(Dromaius::CLEAR_PROFILE);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Export")) {
+		send(Dromaius::EXPORT_PROFILE);
+	}
+	ImGui::SameLine();
+	ImGui::Text("%zu functions", functions.size());
+
+	std::vector<uint32_t> order(functions.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	size_t rows = std::min(order.size(), (size_t)GUI_PROFILE_ROWS);
+	std::partial_sort(order.begin(), order.begin() + rows, order.end(), [&functions](uint32_t a, uint32_t b) {
+		return functions[a].lastFrameSelf > functions[b].lastFrameSelf;
+	});
+
+	if (not ImGui::BeginTable("profile", 4, ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_RowBg)) {
+		return;
+	}
+	ImGui::TableSetupColumn("function");
+	ImGui::TableSetupColumn("calls/frame");
+	ImGui::TableSetupColumn("self/frame");
+	ImGui::TableSetupColumn("total");
+	ImGui::TableHeadersRow();
+
+	char name[64];
+	for (size_t row = 0; row < rows; row++) {
+		uint32_t index = order[row];
+		Profiler::function_t const &function = functions[index];
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		emu->symbols.format(name, sizeof(name), function.bank, function.addr);
+		ImGui::Text("%02X:%04X %s", function.bank, function.addr, name);
+
+		if (ImGui::IsItemHovered()) {
+			ImGui::BeginTooltip();
+			for (Profiler::edge_t const &edge : snapshot.edges) {
+				bool caller = edge.callee == index;
+				if (caller or edge.caller == index) {
+					Profiler::function_t const &other = functions[caller ? edge.caller : edge.callee];
+					emu->symbols.format(name, sizeof(name), other.bank, other.addr);
+					ImGui::Text("%s %02X:%04X %s, %llu calls, %llu cycles", caller ? "from" : "  to",
+						other.bank, other.addr, name, (unsigned long long)edge.calls, (unsigned long long)edge.cycles);
+				}
+			}
+			ImGui::EndTooltip();
+		}
+
+		ImGui::TableNextColumn();
+		ImGui::Text("%u", function.lastFrameCalls);
+		ImGui::TableNextColumn();
+		ImGui::Text("%llu (%.1f%%)", (unsigned long long)function.lastFrameSelf,
+			100.0f * function.lastFrameSelf / CPU_CLOCKS_PER_FRAME);
+		ImGui::TableNextColumn();
+		ImGui::Text("%llu calls, %llu cycles", (unsigned long long)function.calls, (unsigned long long)function.cycles);
+	}
+	ImGui::EndTable();
+}
+
+// Whole segments from the cache, only the visible lines are drawn
+void GUI::renderDisassembly()
+{
+	Disassembly &disasm = emu->disassembly;
+	uint16_t pc = snapshot.cpu.r.pc;
+	int pcSegment = disasm.segmentAt(pc, snapshot.romBank);
+	disasmShown = true;
+
+	// Jump to a symbol, in its own bank
+	if (const Symbols::symbol_t *symbol = renderSymbolSearch("##disasmsearch", disasmSearch)) {
+		int segment = disasm.segmentAt(symbol->addr, symbol->bank);
+		if (segment >= 0) {
+			disasmSegment = segment;
+			disasmJumpAddr = symbol->addr;
+			disasmFollowPC = false;
+		}
+	}
+
+	ImGui::Checkbox("Follow PC", &disasmFollowPC);
+	if (disasmFollowPC and pcSegment >= 0) {
+		disasmSegment = pcSegment;
+	}
+
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(100);
+	Disassembly::segment_t *current = disasm.segment(disasmSegment);
+	if (ImGui::BeginCombo("##segment", current ? current->name : "...")) {
+		for (size_t i = 0; i < disasm.segmentCount(); i++) {
+			Disassembly::segment_t *seg = disasm.segment(i);
+			if (seg and ImGui::Selectable(seg->name, (int)i == disasmSegment)) {
+				disasmSegment = i;
+				disasmFollowPC = false;
+			}
+		}
+		ImGui::EndCombo();
+	}
+
+	Analyzer &analyzer = emu->analyzer;
+	Symbols &symbols = emu->symbols;
+	bool analyzed = analyzer.ready;
+	ImGui::SameLine();
+	if (analyzed) {
+		ImGui::Text("%zu instructions, %zu functions", analyzer.instructions, analyzer.functions);
+	} else {
+		ImGui::TextDisabled("Analyzing...");
+	}
+
+	float lineHeight = ImGui::GetTextLineHeightWithSpacing();
+	ImGui::BeginChild("##disassembly", ImVec2(0, 20 * lineHeight));
+
+	Disassembly::segment_t *seg = disasm.segment(disasmSegment);
+	if (not seg) {
+		ImGui::Text("Disassembling...");
+	} else {
+		bool showsPC = disasmSegment == pcSegment;
+		bool inRom = disasmSegment < (int)disasm.rom.size();
+
+		// Keep PC in view when it moves
+		if (disasmFollowPC and showsPC and pc != disasmLastPC) {
+			ImGui::SetScrollY(((float)disasm.lineAt(*seg, pc) - 5) * lineHeight);
+		}
+		disasmLastPC = pc;
+
+		if (disasmJumpAddr >= 0) {
+			ImGui::SetScrollY((float)disasm.lineAt(*seg, disasmJumpAddr) * lineHeight);
+			disasmJumpAddr = -1;
+		}
+
+		ImGuiListClipper clipper;
+		clipper.Begin(disasm.lineCount(*seg), lineHeight);
+		while (clipper.Step()) {
+			for (int n = clipper.DisplayStart; n < clipper.DisplayEnd; n++) {
+				Disassembly::line_t const &line = disasm.line(*seg, n);
+				if (not line.label.empty()) {
+					ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.5f, 1.0f), "%.*s:", (int)line.label.size(), line.label.data());
 				} else {
-					ImGui::Text("%d: %04X", i, emu->cpu.callStack[i]);
+					bool atPC = showsPC and pc >= line.addr and pc < line.addr + line.len;
+					bool isCode = not analyzed or not inRom or (analyzer.flags(seg->bank, line.addr) & Analyzer::INSTRUCTION);
+
+					// Name jump and call targets, in this bank if it's switchable
+					char target[64] = "";
+					if (line.target >= 0) {
+						uint8_t bank = line.target < 0x4000 ? 0 : inRom and seg->bank ? seg->bank : currentBank(line.target);
+						symbols.format(target, sizeof(target), bank, line.target);
+					}
+					const char *comment = target[0] ? " ; " : "";
+
+					// Bytes never reached from code are most likely data
+					if (isCode) {
+						ImGui::Text("%c%02X:%04X  %-16s%s%s", atPC ? '>' : ' ', seg->bank, line.addr, line.text, comment, target);
+					} else {
+						ImGui::TextDisabled("%c%02X:%04X  %-16s%s%s", atPC ? '>' : ' ', seg->bank, line.addr, line.text, comment, target);
+					}
+
+					if (analyzed and inRom and ImGui::IsItemHovered()) {
+						auto refs = analyzer.referencesTo(seg->bank, line.addr);
+						if (refs.first != refs.second) {
+							ImGui::BeginTooltip();
+							for (const Analyzer::ref_t *ref = refs.first; ref != refs.second; ref++) {
+								char from[64];
+								symbols.format(from, sizeof(from), ref->fromBank, ref->from);
+								ImGui::Text("%s from %02X:%04X %s", ref->kind == Analyzer::CALL ? "call" : "jump",
+									ref->fromBank, ref->from, from);
+							}
+							ImGui::EndTooltip();
+						}
+					}
 				}
 			}
 		}
 	}
 
-	ImGui::End();
+	ImGui::EndChild();
 }
 
-// hack for lambda..
-Dromaius *g_emu;
+// Decimate the last 100 ms of each channel to a min/max per column, so
+// short pulses still show up
+void GUI::updateScope()
+{
+	const size_t window = AUDIO_SCOPE_RATE / 10;
+	int8_t levels[window];
+
+	for (int ch = 0; ch < 4; ch++) {
+		size_t lost = emu->scope[ch].readLatest(levels, window);
+
+		for (int bin = 0; bin < GUI_SCOPE_BINS; bin++) {
+			size_t from = bin * window / GUI_SCOPE_BINS;
+			size_t to = (bin + 1) * window / GUI_SCOPE_BINS;
+			from = std::max(from, lost);
+
+			int8_t lo = 0, hi = 0;
+			if (from < to) {
+				lo = hi = levels[from];
+				for (size_t i = from + 1; i < to; i++) {
+					lo = std::min(lo, levels[i]);
+					hi = std::max(hi, levels[i]);
+				}
+			}
+			scopeMin[ch][bin] = lo;
+			scopeMax[ch][bin] = hi;
+		}
+	}
+}
+
+// One vertical line per column from min to max, levels are -15..15
+void GUI::renderScope(int ch)
+{
+	ImVec2 pos = ImGui::GetCursorScreenPos();
+	ImVec2 size(ImGui::GetContentRegionAvail().x, 48.0f);
+	ImDrawList *drawList = ImGui::GetWindowDrawList();
+
+	drawList->AddRectFilled(pos, ImVec2(pos.x + size.x, pos.y + size.y), IM_COL32(32,32,32,255));
+	for (int bin = 0; bin < GUI_SCOPE_BINS; bin++) {
+		float x = pos.x + bin * size.x / GUI_SCOPE_BINS;
+		float top = pos.y + (15.0f - scopeMax[ch][bin]) * size.y / 30.0f;
+		float bottom = pos.y + (15.0f - scopeMin[ch][bin]) * size.y / 30.0f;
+		drawList->AddLine(ImVec2(x, top), ImVec2(x, bottom + 1.0f), IM_COL32(255,255,255,255));
+	}
+	ImGui::Dummy(size);
+}
 
 void GUI::renderAudioWindow() {
 	ImGui::Begin("Audio", nullptr);
 
-	if (emu->memory.romLoaded) {
+	if (snapshot.romLoaded) {
 		if (ImGui::Button("mute")) {
-			SDL_PauseAudioDevice(emu->audio.dev, 1);
+			SDL_PauseAudioDevice(snapshot.audioDev, 1);
 		}
 		ImGui::SameLine();
 		if (ImGui::Button("unmute")) {
-			SDL_PauseAudioDevice(emu->audio.dev, 0);
+			SDL_PauseAudioDevice(snapshot.audioDev, 0);
 		}
 
-		ImGui::Text("Enabled: %s", emu->audio.isEnabled ? "yes" : "no");
+		ImGui::Text("Enabled: %s", snapshot.audioEnabled ? "yes" : "no");
+
+		ImGui::SetNextItemWidth(80);
+		settingsChanged |= ImGui::Combo("Resampling", &snapshot.settings.audioQuality, "Fast\0Normal\0Best\0");
+		ImGui::SetNextItemWidth(80);
+		settingsChanged |= ImGui::SliderInt("Latency (ms)", &snapshot.settings.audioLatency, 20, 60);
+		ImGui::Text("Queued: %.1f ms, rate %+.2f%%",
+			snapshot.queueFill * 1000.0f / AUDIO_SAMPLE_RATE, snapshot.rateAdjust * 100.0f);
+		ImGui::Text("Underruns: %u, overruns: %u",
+			emu->audioUnderruns.load(), emu->audioOverruns.load());
 
 		ImGui::Separator();
 
 		// Show waveram values as plot
-		g_emu = emu;
+		float wave[32];
+		for (int i = 0; i < 32; i++) {
+			wave[i] = snapshot.waveRam[i / 2] & ((i % 2) ? 0xF0 : 0x0F);
+		}
 		ImGui::Text("waveram: ");
 		ImGui::SameLine();
 		ImGui::PushItemWidth(-1);
-		ImGui::PlotLines("",
-			[](void *data, int idx) { return (float)(g_emu->audio.waveRam[idx/2] & ((idx % 2) ? 0xF0 : 0x0F));}, NULL, 32);
+		ImGui::PlotLines("##waveram", wave, 32);
 		ImGui::PopItemWidth();
 
 		ImGui::Separator();
 
-		// Show waveforms of last N samples
-		ImGui::Text("ch1 (%s): ", emu->audio.ch1.isEnabled ? "on " : "off");
-		ImGui::SameLine();
-		ImGui::PushItemWidth(-1);
-		ImGui::PlotLines("", [](void*data, int idx) { return (float)g_emu->audio.sampleHistory[0][(idx + g_emu->cpu.c) % AUDIO_SAMPLE_HISTORY_SIZE]; }, NULL, AUDIO_SAMPLE_HISTORY_SIZE);
-		ImGui::PopItemWidth();
-
-		ImGui::Text("ch2 (%s): ", emu->audio.ch2.isEnabled ? "on " : "off");
-		ImGui::SameLine();
-		ImGui::PushItemWidth(-1);
-		ImGui::PlotLines("", [](void*data, int idx) { return (float)g_emu->audio.sampleHistory[1][(idx + g_emu->cpu.c) % AUDIO_SAMPLE_HISTORY_SIZE]; }, NULL, AUDIO_SAMPLE_HISTORY_SIZE);
-		ImGui::PopItemWidth();
-		
-		ImGui::Text("ch3 (%s): ", emu->audio.ch3.isEnabled ? "on " : "off");
-		ImGui::SameLine();
-		ImGui::PushItemWidth(-1);
-		ImGui::PlotLines("", [](void*data, int idx) { return (float)g_emu->audio.sampleHistory[2][(idx + g_emu->cpu.c) % AUDIO_SAMPLE_HISTORY_SIZE]; }, NULL, AUDIO_SAMPLE_HISTORY_SIZE);
-		ImGui::PopItemWidth();
-		
-		ImGui::Text("ch4 (%s): ", emu->audio.ch4.isEnabled ? "on " : "off");
-		ImGui::SameLine();
-		ImGui::PushItemWidth(-1);
-		ImGui::PlotLines("", [](void*data, int idx) { return (float)g_emu->audio.sampleHistory[3][(idx + g_emu->cpu.c) % AUDIO_SAMPLE_HISTORY_SIZE]; }, NULL, AUDIO_SAMPLE_HISTORY_SIZE);
-		ImGui::PopItemWidth();
+		// Show waveforms of the last 100 ms
+		updateScope();
+		for (int ch = 0; ch < 4; ch++) {
+			ImGui::Text("ch%d (%s): ", ch + 1, snapshot.channelEnabled[ch] ? "on " : "off");
+			renderScope(ch);
+		}
 	}
 
 	ImGui::End();
@@ -343,29 +815,32 @@ void GUI::renderAudioWindow() {
 
 
 void GUI::renderGraphicsDebugWindow() {
-	ImGui::Begin("Graphics", nullptr);
+	// Debug views are only brought up to date while they're on screen
+	bool visible = ImGui::Begin("Graphics", nullptr);
 
-	if (emu->memory.romLoaded) {
+	if (visible and snapshot.romLoaded) {
 		// Basic flags info dump
-		ImGui::Text("background: %s", (emu->graphics.r.flags & Graphics::Flag::BG) ? "on " : "off");
-		ImGui::Text("    tileset: %s", (emu->graphics.r.flags & Graphics::Flag::TILESET) ? "8000-8FFF" : "8800-97FF");
-		ImGui::Text("    tilemap: %s", (emu->graphics.r.flags & Graphics::Flag::TILEMAP) ? "9C00-9FFF" : "9800-9BFF");
-		ImGui::Text("    scroll: (%02X,%02X)", emu->graphics.r.scx, emu->graphics.r.scy);
+		ImGui::Text("background: %s", (snapshot.r.flags & Graphics::Flag::BG) ? "on " : "off");
+		ImGui::Text("    tileset: %s", (snapshot.r.flags & Graphics::Flag::TILESET) ? "8000-8FFF" : "8800-97FF");
+		ImGui::Text("    tilemap: %s", (snapshot.r.flags & Graphics::Flag::TILEMAP) ? "9C00-9FFF" : "9800-9BFF");
+		ImGui::Text("    scroll: (%02X,%02X)", snapshot.r.scx, snapshot.r.scy);
 		ImGui::Separator();
-		ImGui::Text("window: %s", (emu->graphics.r.flags & Graphics::Flag::WINDOW) ? "on " : "off");
-		ImGui::Text("    position: (%02X,%02X)", emu->graphics.r.winx, emu->graphics.r.winy);
-		ImGui::Text("    tilemap: %s", (emu->graphics.r.flags & Graphics::Flag::WINDOWTILEMAP) ? "9C00-9FFF" : "9800-9BFF");
+		ImGui::Text("window: %s", (snapshot.r.flags & Graphics::Flag::WINDOW) ? "on " : "off");
+		ImGui::Text("    position: (%02X,%02X)", snapshot.r.winx, snapshot.r.winy);
+		ImGui::Text("    tilemap: %s", (snapshot.r.flags & Graphics::Flag::WINDOWTILEMAP) ? "9C00-9FFF" : "9800-9BFF");
 		ImGui::Separator();
-		ImGui::Text("sprites: %s", (emu->graphics.r.flags & Graphics::Flag::SPRITES) ? "on " : "off");
-		ImGui::Text("    size: %s", (emu->graphics.r.flags & Graphics::Flag::SPRITESIZE) ? "8x16" : "8x8");
+		ImGui::Text("sprites: %s", (snapshot.r.flags & Graphics::Flag::SPRITES) ? "on " : "off");
+		ImGui::Text("    size: %s", (snapshot.r.flags & Graphics::Flag::SPRITESIZE) ? "8x16" : "8x8");
 		ImGui::Separator();
 		ImGui::Text("GPU state:");
-		ImGui::Text("    mode: %s", emu->graphics.modeToString(emu->graphics.mode));
-		ImGui::Text("    line: %03d/%d (comp: %d)", emu->graphics.r.line, 144, emu->graphics.r.lineComp);
+		ImGui::Text("    mode: %s", emu->graphics.modeToString(snapshot.mode));
+		ImGui::Text("    line: %03d/%d (comp: %d)", snapshot.r.line, 144, snapshot.r.lineComp);
 
 
 
 		if (ImGui::CollapsingHeader("Sprites", ImGuiTreeNodeFlags_DefaultOpen)) {
+			debugViewsShown |= 1 << (int)Graphics::DebugView::TILESET;
+
 			if (ImGui::BeginTable("sprites", 5, ImGuiTableFlags_SizingFixedFit)) {
 
 				// Column sizing
@@ -376,8 +851,8 @@ void GUI::renderGraphicsDebugWindow() {
 				ImGui::TableSetupColumn("5", ImGuiTableColumnFlags_None, 16);
 
 				for (int i = 0; i < 40; i++) {
-					int spriteVisible = ((emu->graphics.spritedata[i].x > -8 and emu->graphics.spritedata[i].x < 168)
-						and (emu->graphics.spritedata[i].y > -16 and emu->graphics.spritedata[i].y < 160));
+					int spriteVisible = ((snapshot.spritedata[i].x > -8 and snapshot.spritedata[i].x < 168)
+						and (snapshot.spritedata[i].y > -16 and snapshot.spritedata[i].y < 160));
 
 					// slightly make elements transparent if not visible
 					if (not spriteVisible) {
@@ -385,8 +860,8 @@ void GUI::renderGraphicsDebugWindow() {
 					}
 
 					if (spriteVisible) {
-						int tilex = emu->graphics.spritedata[i].tile % 16;
-						int tiley = emu->graphics.spritedata[i].tile >> 4;
+						int tilex = snapshot.spritedata[i].tile % 16;
+						int tiley = snapshot.spritedata[i].tile >> 4;
 
 						// Draw image with details on hover
 						ImGui::Image((void*)((intptr_t)emu->graphics.debugTexture), ImVec2(16,16), ImVec2(tilex*(1.0/16),tiley*(1.0/24)), ImVec2((tilex+1)*(1.0/16),(tiley+1)*(1.0/24)), ImColor(255,255,255,255), ImColor(0,0,0,0));
@@ -397,8 +872,8 @@ void GUI::renderGraphicsDebugWindow() {
 						ImGui::Dummy(ImVec2(16.0f, 16.0f));
 					}
 					renderHoverText("%2d (0x%2X) (%3d,%3d) f:%02X: ", i,
-						emu->graphics.spritedata[i].x, emu->graphics.spritedata[i].y,
-						emu->graphics.spritedata[i].tile, emu->graphics.spritedata[i].flags);
+						snapshot.spritedata[i].x, snapshot.spritedata[i].y,
+						snapshot.spritedata[i].tile, snapshot.spritedata[i].flags);
 
 					if (not spriteVisible) {
 						ImGui::PopStyleVar();
@@ -411,7 +886,67 @@ void GUI::renderGraphicsDebugWindow() {
 			}
 		}
 
+		if (ImGui::CollapsingHeader("OAM")) {
+			debugViewsShown |= 1 << (int)Graphics::DebugView::OAM;
+			int oamScale = 3;
+
+			ImVec2 tex_screen_pos = ImGui::GetCursorScreenPos();
+			ImGui::Image((void*)((intptr_t)emu->graphics.debugOAMTexture), ImVec2(DEBUG_OAM_WIDTH * oamScale, DEBUG_OAM_HEIGHT * oamScale),
+			ImVec2(0,0), ImVec2(1,1), ImColor(255,255,255,255), ImColor(0,0,0,0));
+			if (ImGui::IsItemHovered()) {
+				int spritex = (int)(ImGui::GetMousePos().x - tex_screen_pos.x) / (8 * oamScale);
+				int spritey = (int)(ImGui::GetMousePos().y - tex_screen_pos.y) / (16 * oamScale);
+				int i = spritey * 8 + spritex;
+				if (i >= 0 and i < 40) {
+					Graphics::sprite_s const &sprite = snapshot.spritedata[i];
+					renderHoverText("%2d @ %04X: (%3d,%3d) tile:%02X f:%02X", i, 0xFE00 + i * 4,
+						sprite.x, sprite.y, sprite.tile, sprite.flags);
+				}
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Background maps")) {
+			for (int map = 0; map < 2; map++) {
+				debugViewsShown |= 1 << (int)(map ? Graphics::DebugView::TILEMAP1 : Graphics::DebugView::TILEMAP0);
+
+				if (map) {
+					ImGui::SameLine();
+				}
+				ImGui::BeginGroup();
+				ImGui::Text("%s", map ? "9C00-9FFF" : "9800-9BFF");
+
+				ImVec2 tex_screen_pos = ImGui::GetCursorScreenPos();
+				ImGui::Image((void*)((intptr_t)emu->graphics.debugMapTexture[map]), ImVec2(DEBUG_MAP_SIZE, DEBUG_MAP_SIZE),
+				ImVec2(0,0), ImVec2(1,1), ImColor(255,255,255,255), ImColor(0,0,0,0));
+				if (ImGui::IsItemHovered()) {
+					int tilex = (int)(ImGui::GetMousePos().x - tex_screen_pos.x) / 8;
+					int tiley = (int)(ImGui::GetMousePos().y - tex_screen_pos.y) / 8;
+					int entryaddr = (map ? TILEMAP_ADDR1 : TILEMAP_ADDR0) + tiley * 32 + tilex;
+					renderHoverText("(%2d,%2d) @ %04X: tile %02X", tilex, tiley, 0x8000 + entryaddr,
+						snapshot.vram[entryaddr]);
+				}
+
+				// Outline the visible background area on the active map
+				bool active = (snapshot.r.flags & Graphics::Flag::TILEMAP) ? map == 1 : map == 0;
+				if (active) {
+					ImDrawList *drawList = ImGui::GetWindowDrawList();
+					drawList->PushClipRect(tex_screen_pos, ImVec2(tex_screen_pos.x + DEBUG_MAP_SIZE, tex_screen_pos.y + DEBUG_MAP_SIZE), true);
+					// Draw wrapped copies so the outline wraps around the edges like the scroll does
+					for (int wy = -1; wy <= 0; wy++) {
+						for (int wx = -1; wx <= 0; wx++) {
+							float x = tex_screen_pos.x + snapshot.r.scx + wx * DEBUG_MAP_SIZE;
+							float y = tex_screen_pos.y + snapshot.r.scy + wy * DEBUG_MAP_SIZE;
+							drawList->AddRect(ImVec2(x, y), ImVec2(x + GB_SCREEN_WIDTH, y + GB_SCREEN_HEIGHT), IM_COL32(255,0,0,255));
+						}
+					}
+					drawList->PopClipRect();
+				}
+				ImGui::EndGroup();
+			}
+		}
+
 		if (ImGui::CollapsingHeader("Background tileset", ImGuiTreeNodeFlags_DefaultOpen)) {
+			debugViewsShown |= 1 << (int)Graphics::DebugView::TILESET;
 			int tilemapScale = 2;
 
 			ImVec2 tex_screen_pos = ImGui::GetCursorScreenPos();
@@ -430,7 +965,7 @@ void GUI::renderGraphicsDebugWindow() {
 
 			// Grey out the inactive tiles
 			int topInactiveTile, bottomInactiveLine;
-			if (emu->graphics.r.flags & Graphics::Flag::TILESET) {
+			if (snapshot.r.flags & Graphics::Flag::TILESET) {
 				// active: 8000-8FFF
 				topInactiveTile = 16 * 8;
 				bottomInactiveLine = 24 * 8;
@@ -450,16 +985,16 @@ void GUI::renderGraphicsDebugWindow() {
 }
 
 void GUI::renderMemoryViewerWindow() {
-	uint16_t lineBuffer[16];
 	uint8_t charBuffer[16];
 	int jumpAddr = -1;
 
 	const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
     const float TEXT_BASE_HEIGHT = ImGui::GetTextLineHeightWithSpacing();
 
-	ImGui::Begin("Memory viewer", nullptr);
+	// The memory is only copied while it's on screen
+	memoryViewShown = ImGui::Begin("Memory viewer", nullptr) and snapshot.romLoaded;
 
-	if (emu->memory.romLoaded) {
+	if (memoryViewShown) {
 		if (ImGui::BeginTable("jumps", 2, ImGuiTableFlags_BordersInnerV)) {
 			// Jump to addr
 			static char hexBuf[5] = {0x00};
@@ -477,16 +1012,30 @@ void GUI::renderMemoryViewerWindow() {
 			ImGui::Text("Jump to: ");
 			ImGui::SameLine();
 			if (ImGui::Button("SP")) {
-				jumpAddr = emu->cpu.r.sp;
+				jumpAddr = snapshot.cpu.r.sp;
 			}
 			ImGui::SameLine();
 			if (ImGui::Button("PC")) {
-				jumpAddr = emu->cpu.r.pc;
+				jumpAddr = snapshot.cpu.r.pc;
 			}
 
 			ImGui::EndTable();
 		}
 
+		// Jump to a symbol, showing its bank if it's in a switchable region
+		if (const Symbols::symbol_t *symbol = renderSymbolSearch("##memorysearch", memorySearch)) {
+			jumpAddr = symbol->addr;
+			bool switchable = (symbol->addr >= 0x4000 and symbol->addr < 0x8000) or (symbol->addr >= 0xA000 and symbol->addr < 0xC000);
+			memoryViewBank = switchable ? symbol->bank : MEMORY_BANK_CURRENT;
+		}
+		if (memoryViewBank != MEMORY_BANK_CURRENT) {
+			ImGui::Text("Showing bank %02X", memoryViewBank);
+			ImGui::SameLine();
+			if (ImGui::Button("Current banks")) {
+				memoryViewBank = MEMORY_BANK_CURRENT;
+			}
+		}
+
 	 	
 	 	ImGuiTableFlags flags = 
 	 		ImGuiTableFlags_BordersV | 
@@ -532,14 +1081,15 @@ void GUI::renderMemoryViewerWindow() {
 
 					// Region
 					ImGui::TableNextColumn();
-					ImGui::Text("%s", emu->memory.getRegionName(addr << 4).c_str());
+					std::string_view region = snapshot.biosLoaded and addr < 0x10 ? "BIOS" : memoryRegion(addr << 4).name;
+					ImGui::TextUnformatted(region.data(), region.data() + region.size());
 
 					// Address
 					ImGui::TableNextColumn();
 					ImGui::Text("%03X0", addr);
 
+					const uint8_t *lineBuffer = &memoryViewBuffer[addr << 4];
 					for (int i = 0; i < 16; ++i) {
-						lineBuffer[i] = emu->memory.readByte((addr << 4) + i);
 						charBuffer[i] = (lineBuffer[i] >= 0x20 and lineBuffer[i] <= 0x7E) ? lineBuffer[i] : '.';
 					}
 
@@ -557,7 +1107,7 @@ void GUI::renderMemoryViewerWindow() {
 						
 						// Don't show popup on space
 						if (offset % 5 != 4) {
-							auto hoverAddr = (addr << 8) + (offset / 5) * 2 + (offset % 5) / 2;
+							auto hoverAddr = (addr << 4) + (offset / 5) * 2 + (offset % 5) / 2;
 
 							ImGui::BeginTooltip();
 							ImGui::Text("0x%04X", hoverAddr);
@@ -576,7 +1126,7 @@ void GUI::renderMemoryViewerWindow() {
 					);
 					if (ImGui::IsItemHovered()) {
 						int offset = (int)(ImGui::GetMousePos().x - hex_screen_pos.x) / TEXT_BASE_WIDTH;
-						auto hoverAddr = (addr << 8) + offset;
+						auto hoverAddr = (addr << 4) + offset;
 
 						ImGui::BeginTooltip();
 						ImGui::Text("0x%04X", hoverAddr);
@@ -597,12 +1147,18 @@ void GUI::renderMemoryViewerWindow() {
 void GUI::renderGameSpecificWindow() {
 	ImGui::Begin("Game-specific", nullptr);
 
-	if (emu->memory.romLoaded) {
+	if (snapshot.romLoaded) {
 		// Window contents is game-dependent
-		auto romheader = (Memory::romheader_t *)(emu->memory.rom + 0x134); 
-		auto gameName = std::string(romheader->gamename);
+		auto gameName = std::string(snapshot.gameName);
 		if (gameName == "POKEMON RED") {
-			gameGUI_pokemon_red(emu);
+			// Edits are written back byte by byte by the emulation thread
+			memcpy(gameWorkram, snapshot.workram, sizeof(gameWorkram));
+			gameGUI_pokemon_red(gameWorkram);
+			for (uint16_t i = 0; i < sizeof(gameWorkram); i++) {
+				if (gameWorkram[i] != snapshot.workram[i]) {
+					send(Dromaius::POKE, gameWorkram[i], 0xC000 + i);
+				}
+			}
 		} else {
 			ImGui::Text("Sorry, no special features for this game.");
 		}
@@ -618,12 +1174,38 @@ void GUI::renderGBScreenWindow() {
 	// ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
 	ImGui::Begin("LCD", nullptr);
 
-	if (emu->memory.romLoaded) {
+	if (snapshot.romLoaded) {
 		// Scaling	
-		ImGui::SliderInt("Scale factor", (int *)&emu->graphics.screenScale, 1, 5);
+		ImGui::SliderInt("Scale factor", &screenScale, 1, 5);
+
+		// Palette, only applied when the frame is presented
+		static const uint32_t palettePresets[][4] = {
+			{IM_COL32(255, 255, 255, 255), IM_COL32(192, 192, 192, 255), IM_COL32(96, 96, 96, 255), IM_COL32(0, 0, 0, 255)},
+			{IM_COL32(155, 188, 15, 255), IM_COL32(139, 172, 15, 255), IM_COL32(48, 98, 48, 255), IM_COL32(15, 56, 15, 255)},
+		};
+		static int paletteIdx = 0;
+		if (ImGui::Combo("Palette", &paletteIdx, "Gray\0DMG green\0Custom\0")) {
+			if (paletteIdx < 2) {
+				memcpy(snapshot.settings.palette, palettePresets[paletteIdx], sizeof(snapshot.settings.palette));
+				settingsChanged = true;
+			}
+		}
+		if (paletteIdx == 2) {
+			for (int i = 0; i < 4; ++i) {
+				ImVec4 col = ImGui::ColorConvertU32ToFloat4(snapshot.settings.palette[i]);
+				ImGui::PushID(i);
+				if (ImGui::ColorEdit3("##shade", &col.x, ImGuiColorEditFlags_NoInputs)) {
+					snapshot.settings.palette[i] = ImGui::ColorConvertFloat4ToU32(col);
+					settingsChanged = true;
+				}
+				ImGui::PopID();
+				ImGui::SameLine();
+			}
+			ImGui::NewLine();
+		}
 
 		// Center the image
-		auto image_size = ImVec2(GB_SCREEN_WIDTH * emu->graphics.screenScale, GB_SCREEN_HEIGHT * emu->graphics.screenScale);
+		auto image_size = ImVec2(GB_SCREEN_WIDTH * screenScale, GB_SCREEN_HEIGHT * screenScale);
 		auto window_size = ImGui::GetWindowSize();
 		ImGui::SetCursorPos(ImVec2((int)(window_size.x - image_size.x)/2, (int)(window_size.y - image_size.y)/2));
 
@@ -636,13 +1218,57 @@ void GUI::renderGBScreenWindow() {
 }
 
 void GUI::renderConsoleWindow() {
+	Logger &logger = emu->logger;
+	settings_t &settings = snapshot.settings;
+
 	// Console window
 	ImGui::Begin("Console", nullptr);
 
-	// TODO: circular log buffer
+	ImGui::SetNextItemWidth(100);
+	if (ImGui::BeginCombo("Level", Logger::levelName(settings.logLevel))) {
+		for (int level = 0; level < Logger::LEVEL_COUNT; level++) {
+			if (ImGui::Selectable(Logger::levelName(level), level == settings.logLevel)) {
+				settings.logLevel = level;
+				settingsChanged = true;
+			}
+		}
+		ImGui::EndCombo();
+	}
+	ImGui::SameLine();
+	settingsChanged |= ImGui::Checkbox("Log to " LOG_FILENAME, &settings.logToFile);
+	ImGui::SameLine();
+	if (ImGui::Button("Clear")) {
+		logger.clear();
+	}
+	if (logger.dropped) {
+		ImGui::SameLine();
+		ImGui::Text("%llu dropped", (unsigned long long)logger.dropped);
+	}
+
+	static const ImVec4 levelColors[] = {
+		ImVec4(0.6f, 0.6f, 0.6f, 1.0f),
+		ImVec4(1.0f, 1.0f, 1.0f, 1.0f),
+		ImVec4(1.0f, 0.8f, 0.3f, 1.0f),
+		ImVec4(1.0f, 0.4f, 0.4f, 1.0f),
+	};
+
+	ImGui::BeginChild("##log");
+	ImGuiListClipper clipper;
+	clipper.Begin(logger.historySize());
+	while (clipper.Step()) {
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+			Logger::record_t const &record = logger.historyAt(i);
+			ImGui::TextColored(levelColors[record.level], "%12llu %-5s %s",
+				record.cycle, Logger::levelName(record.level), record.text);
+		}
+	}
+
+	// Stick to the bottom unless scrolled up
+	if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
+		ImGui::SetScrollHereY(1.0f);
+	}
+	ImGui::EndChild();
 
-	ImGui::Text("TODO");
-	
 	ImGui::End();
 }
 
@@ -655,6 +1281,15 @@ void GUI::triggerRomLoadDialog() {
 
 
 void GUI::render() {
+	// Collect what the emulation logged since last time
+	emu->logger.drain();
+
+	// Set again by the windows that are shown this time
+	disasmShown = false;
+	profileShown = false;
+	memoryViewShown = false;
+	debugViewsShown = 0;
+
 	// Start a new frame
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplSDL2_NewFrame(window);
@@ -711,6 +1346,8 @@ void GUI::render() {
 			ImGui::MenuItem("Graphics info", nullptr, &showGraphicsDebugWindow);
 			ImGui::MenuItem("Audio info", nullptr, &showAudioWindow);
 			ImGui::MenuItem("Memory viewer", nullptr, &showMemoryViewerWindow);
+			ImGui::MenuItem("Console", nullptr, &showConsoleWindow);
+			ImGui::MenuItem("Performance overlay", nullptr, &showPerfOverlay);
 			ImGui::MenuItem("imgui demo window", nullptr, &showImguiDemoWindow);
 			ImGui::EndMenu();
 		}
@@ -772,9 +1409,15 @@ void GUI::render() {
 	if (showGameSpecificWindow)
 		renderGameSpecificWindow();
 
+	if (showConsoleWindow)
+		renderConsoleWindow();
+
 	if (showImguiDemoWindow)
 		ImGui::ShowDemoWindow();
 
+	if (showPerfOverlay)
+		renderPerfOverlay();
+
 
 	ImGui::End(); // main window
 
@@ -786,9 +1429,19 @@ void GUI::render() {
 		auto filename = openRomDialog.GetSelected().string();
 		openRomDialog.ClearSelected();
 
+		std::lock_guard<std::mutex> lock(emu->stateMutex);
 		emu->unloadRom();
 		emu->initializeWithRom(filename.c_str());
 	}
 
+	// The GUI changes all settings but the debug toggle, which is a key
+	if (settingsChanged) {
+		std::lock_guard<std::mutex> lock(emu->stateMutex);
+		int debug = emu->settings.debug;
+		emu->settings = snapshot.settings;
+		emu->settings.debug = debug;
+		settingsChanged = false;
+	}
+
 	ImGui::Render();
 }
\ No newline at end of file
@@ -2,10 +2,66 @@
 #define INCLUDED_GUI_H
 
 #include <cstdint>
+#include <vector>
+#include "cpu.h"
+#include "graphics.h"
+#include "memory.h"
+#include "perf.h"
+#include "profiler.h"
+#include "settings.h"
+#include "symbols.h"
 struct Dromaius;
 
+#define GUI_SCOPE_BINS 256 // oscilloscope columns
+#define GUI_SEARCH_RESULTS 12
+#define GUI_PROFILE_ROWS 20
+
 struct GUI
 {
+	// Symbol search box, results are indices into Symbols::byName
+	typedef struct symbolSearch_s {
+		char query[64];
+		char lastQuery[64];
+		size_t symbolCount; // of the table that was searched
+		uint32_t results[GUI_SEARCH_RESULTS];
+		size_t resultCount;
+	} symbolSearch_t;
+
+	// Emulation state copied between two frames. The windows are built
+	// from this, so the emulation only waits while it's being copied.
+	typedef struct snapshot_s {
+		bool romLoaded;
+		bool biosLoaded;
+		char gameName[16];
+		char romInfo[256]; // from the header, the ROM may be unloaded meanwhile
+		uint8_t romBank; // mapped at 4000-7FFF
+		uint8_t ramBank; // mapped at A000-BFFF
+		float speed;
+		settings_t settings;
+		Perf::summary_t emulation;
+
+		CPU cpu;
+		Graphics::regs_s r;
+		uint8_t mode;
+		Graphics::sprite_s spritedata[40];
+		uint8_t vram[0x2000];
+		uint8_t workram[0x2000];
+
+		bool audioEnabled;
+		bool channelEnabled[4];
+		uint8_t waveRam[16];
+		float queueFill;
+		float rateAdjust;
+		SDL_AudioDeviceID audioDev;
+
+		// Call stack, and the statistics only while the profile is shown
+		int depth;
+		uint64_t resyncs;
+		Profiler::frame_t stack[PROFILER_STACK_SIZE];
+		std::vector<Profiler::function_t> functions;
+		std::vector<Profiler::edge_t> edges;
+	} snapshot_t;
+
 	// Up-reference
 	Dromaius *emu;
 	
@@ -15,26 +71,69 @@ struct GUI
 	bool showAudioWindow = true;
 	bool showMemoryViewerWindow = true;
 	bool showGameSpecificWindow = true;
+	bool showConsoleWindow = true;
+	bool showPerfOverlay = false;
 	bool showImguiDemoWindow = false;
 
 	// SDL/gl contexts
-	SDL_Window *window;
+	SDL_Window *window = nullptr;
 	SDL_GLContext glcontext;
 	const char* glsl_version;
+	bool vsync;
+
+	snapshot_t snapshot;
+	bool settingsChanged = false; // in the snapshot, to be written back
+
+	// Parts that are only copied while their window was shown last frame
+	bool disasmShown = false;
+	bool profileShown = false;
+	bool memoryViewShown = false;
+	uint32_t debugViewsShown = 0; // bit per Graphics::DebugView
+
+	// Oscilloscope, min/max of the channel levels per column
+	float scopeMin[4][GUI_SCOPE_BINS];
+	float scopeMax[4][GUI_SCOPE_BINS];
+
+	// Disassembly view
+	int disasmSegment = 0;
+	bool disasmFollowPC = true;
+	int disasmLastPC = -1;
+	int disasmJumpAddr = -1; // scroll to this once the segment is shown
+	symbolSearch_t disasmSearch = {};
+
+	// Memory viewer, the whole address space
+	uint8_t memoryViewBuffer[0x10000];
+	int memoryViewBank = MEMORY_BANK_CURRENT; // for the switchable regions
+	symbolSearch_t memorySearch = {};
 	ImGui::FileBrowser openRomDialog;
 
+	int screenScale = 3;
+	uint8_t gameWorkram[0x2000]; // edited by the game-specific window
+
 	GUI();
 	~GUI();
+	void initDisplay();
+	void takeSnapshot();
+	void refreshViews();
 	void render();
 
 private:
+	void send(uint8_t type, int value = 0, uint16_t addr = 0);
+	uint8_t currentBank(uint16_t addr);
 	void initializeImgui();
 	void triggerRomLoadDialog();
 	void renderHoverText(const char *fmt, ...);
+	const Symbols::symbol_t *renderSymbolSearch(const char *id, symbolSearch_t &search);
 	void renderInfoWindow();
+	void renderPerformance();
+	void renderPerfOverlay();
 	void renderSettingsWindow();
 	void renderCPUDebugWindow();
+	void renderDisassembly();
+	void renderProfile();
 	void renderAudioWindow();
+	void updateScope();
+	void renderScope(int ch);
 	void renderGraphicsDebugWindow();
 	void renderGBScreenWindow();
 	void renderMemoryViewerWindow();
@@ -0,0 +1,156 @@
+#ifndef INCLUDED_LOCKFREE_H
+#define INCLUDED_LOCKFREE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+// Hands the latest complete item from one producer thread to one consumer
+// thread. Neither side ever waits; the consumer may skip items.
+template <typename T>
+struct TripleBuffer
+{
+	T buffers[3];
+
+	// Producer and consumer each own one buffer, the third is exchanged
+	// through middle. FRESH marks it as published but not yet taken.
+	static constexpr uint8_t FRESH = 0x4;
+	std::atomic<uint8_t> middle = 0;
+	uint8_t back = 1;
+	uint8_t front = 2;
+
+	// Producer side
+	T &writeBuffer() { return buffers[back]; }
+	void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 0x3; }
+
+	// Consumer side, returns whether readBuffer() changed
+	bool update()
+	{
+		if (not (middle.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel) & 0x3;
+		return true;
+	}
+	T const &readBuffer() const { return buffers[front]; }
+};
+
+// Bounded single producer, single consumer FIFO. Capacity must be a power
+// of two; push fails instead of blocking when it's full.
+template <typename T, size_t CAPACITY>
+struct SPSCQueue
+{
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+	T items[CAPACITY];
+	alignas(64) std::atomic<size_t> head = 0; // written by consumer
+	alignas(64) std::atomic<size_t> tail = 0; // written by producer
+
+	bool push(T const &item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+			return false;
+		}
+		items[t & (CAPACITY - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = items[h & (CAPACITY - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Bulk versions, return how many items were actually moved
+	size_t pushMany(T const *src, size_t len)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t space = CAPACITY - (t - head.load(std::memory_order_acquire));
+		len = len < space ? len : space;
+		for (size_t i = 0; i < len; i++) {
+			items[(t + i) & (CAPACITY - 1)] = src[i];
+		}
+		tail.store(t + len, std::memory_order_release);
+		return len;
+	}
+
+	size_t popMany(T *dest, size_t len)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t available = tail.load(std::memory_order_acquire) - h;
+		len = len < available ? len : available;
+		for (size_t i = 0; i < len; i++) {
+			dest[i] = items[(h + i) & (CAPACITY - 1)];
+		}
+		head.store(h + len, std::memory_order_release);
+		return len;
+	}
+
+	// Consumer side, drops items without reading them
+	size_t discard(size_t len)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t available = tail.load(std::memory_order_acquire) - h;
+		len = len < available ? len : available;
+		head.store(h + len, std::memory_order_release);
+		return len;
+	}
+
+	size_t size() const
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+};
+
+// Overwriting history of the latest items from one producer thread, for
+// any number of readers. The producer never waits. Readers copy what they
+// need and use the sequence counters to drop items that were overwritten
+// while copying. Capacity must be a power of two.
+template <typename T, size_t CAPACITY>
+struct CaptureRing
+{
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+	std::atomic<T> items[CAPACITY] = {};
+	std::atomic<size_t> claimed = 0; // written up to here, or about to be
+	std::atomic<size_t> written = 0; // written up to here
+
+	void pushMany(T const *src, size_t len)
+	{
+		size_t w = written.load(std::memory_order_relaxed);
+		claimed.store(w + len, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < len; i++) {
+			items[(w + i) & (CAPACITY - 1)].store(src[i], std::memory_order_relaxed);
+		}
+		written.store(w + len, std::memory_order_release);
+	}
+
+	// Copies the latest len items, oldest first. Returns how many of the
+	// oldest ones were overwritten meanwhile and should be ignored.
+	size_t readLatest(T *dest, size_t len) const
+	{
+		size_t w = written.load(std::memory_order_acquire);
+		size_t start = w - len;
+		for (size_t i = 0; i < len; i++) {
+			dest[i] = items[(start + i) & (CAPACITY - 1)].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// Items before this were never written, or have been overwritten
+		ptrdiff_t first = (ptrdiff_t)claimed.load(std::memory_order_relaxed) - (ptrdiff_t)CAPACITY;
+		first = first < 0 ? 0 : first;
+
+		ptrdiff_t lost = first - (ptrdiff_t)start; // start may have wrapped below zero
+		return lost < 0 ? 0 : lost > (ptrdiff_t)len ? len : lost;
+	}
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstdarg>
+#include "dromaius.h"
+
+Logger::~Logger()
+{
+	if (file) {
+		fclose(file);
+	}
+}
+
+const char *Logger::levelName(uint8_t level)
+{
+	static const char *names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+	return level < LEVEL_COUNT ? names[level] : "?";
+}
+
+// Only formats what will be shown. Once a call site has used up its
+// messages for the window, the rest are counted and reported when it
+// logs again in a later window.
+void Logger::write(site_t &site, Level level, const char *fmt, ...)
+{
+	if (level < emu->settings.logLevel) {
+		return;
+	}
+
+	record_t record;
+	record.cycle = emu->cpu.c;
+	record.level = level;
+
+	if (record.cycle - site.windowStart >= LOG_RATE_WINDOW) {
+		if (site.suppressed) {
+			snprintf(record.text, sizeof(record.text), "(%u similar messages suppressed)", site.suppressed);
+			push(record);
+		}
+		site.windowStart = record.cycle;
+		site.count = 0;
+		site.suppressed = 0;
+	}
+
+	if (site.count == LOG_RATE_LIMIT) {
+		site.suppressed++;
+		return;
+	}
+	site.count++;
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(record.text, sizeof(record.text), fmt, args);
+	va_end(args);
+	push(record);
+}
+
+void Logger::push(record_t const &record)
+{
+	if (not queue.push(record)) {
+		dropped++;
+	}
+}
+
+// GUI thread: move new records into the history, and the file if enabled
+void Logger::drain()
+{
+	if (emu->settings.logToFile and not file) {
+		file = fopen(LOG_FILENAME, "a");
+	} else if (not emu->settings.logToFile and file) {
+		fclose(file);
+		file = nullptr;
+	}
+
+	record_t record;
+	while (queue.pop(record)) {
+		if (file) {
+			fprintf(file, "%12llu %-5s %s\n", record.cycle, levelName(record.level), record.text);
+		}
+
+		if (history.size() < LOG_HISTORY_SIZE) {
+			history.push_back(record);
+		} else {
+			history[historyStart] = record;
+			historyStart = (historyStart + 1) % LOG_HISTORY_SIZE;
+		}
+	}
+
+	if (file) {
+		fflush(file);
+	}
+}
+
+void Logger::clear()
+{
+	history.clear();
+	historyStart = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef INCLUDED_LOGGER_H
+#define INCLUDED_LOGGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "lockfree.h"
+struct Dromaius;
+
+#define LOG_TEXT_SIZE 116
+#define LOG_QUEUE_SIZE 1024
+#define LOG_HISTORY_SIZE 4096
+#define LOG_RATE_WINDOW 1048576 // m-cycles, one emulated second
+#define LOG_RATE_LIMIT 8 // messages per call site per window
+#define LOG_FILENAME "dromaius.log"
+
+// Log from the emulation, rate limited per call site:
+// LOG(emu, WARN, "format", ...)
+#define LOG(emu, level, ...) do { \
+	static Logger::site_t logSite; \
+	(emu)->logger.write(logSite, Logger::level, __VA_ARGS__); \
+} while (0)
+
+// Messages from the emulation thread, without ever blocking it on I/O.
+// Records are formatted into a queue, the GUI thread drains them into the
+// Console window's history and optionally a file.
+struct Logger
+{
+	enum Level : uint8_t {
+		DEBUG,
+		INFO,
+		WARN,
+		ERROR,
+		LEVEL_COUNT
+	};
+
+	typedef struct record_s {
+		unsigned long long cycle; // CPU m-cycle
+		uint8_t level;
+		char text[LOG_TEXT_SIZE];
+	} record_t;
+
+	// Per call site, counts messages in the current window
+	typedef struct site_s {
+		unsigned long long windowStart;
+		uint32_t count;
+		uint32_t suppressed;
+	} site_t;
+
+	// Up-reference
+	Dromaius *emu;
+
+	// Producer side
+	SPSCQueue<record_t, LOG_QUEUE_SIZE> queue;
+	std::atomic<uint64_t> dropped = 0; // queue was full
+
+	// Consumer side, a ring of the latest records
+	std::vector<record_t> history;
+	size_t historyStart = 0;
+	FILE *file = nullptr;
+
+	~Logger();
+
+	void write(site_t &site, Level level, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+	void drain();
+	void clear();
+	size_t historySize() const { return history.size(); }
+	record_t const &historyAt(size_t i) const { return history[(historyStart + i) % LOG_HISTORY_SIZE]; }
+	static const char *levelName(uint8_t level);
+
+private:
+	void push(record_t const &record);
+};
+
+#endif
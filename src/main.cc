@@ -19,6 +19,30 @@ settings_t initSettings()
 	settings.keymap.b = SDLK_z;
 	settings.keymap.a = SDLK_x;
 
+	// Classic gray LCD
+	settings.palette[0] = IM_COL32(255, 255, 255, 255);
+	settings.palette[1] = IM_COL32(192, 192, 192, 255);
+	settings.palette[2] = IM_COL32( 96,  96,  96, 255);
+	settings.palette[3] = IM_COL32(  0,   0,   0, 255);
+
+	// Only skip frames when behind or fast-forwarding
+	settings.frameSkip = 0;
+
+	// Fast forward at 4x with sound
+	settings.turboSpeed = 4;
+	settings.turboMute = false;
+
+	// Pace by the performance counter alone
+	settings.audioSync = false;
+
+	// 32-tap resampling is plenty for square waves
+	settings.audioQuality = Resampler::NORMAL;
+	settings.audioLatency = 40;
+
+	// Warnings and errors go to the Console window only
+	settings.logLevel = Logger::WARN;
+	settings.logToFile = false;
+
 	return settings;
 }
 
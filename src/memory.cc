@@ -3,7 +3,6 @@
 #include <iostream>
 #include <filesystem>
 #include <algorithm>
-#include <map>
 #include "dromaius.h"
 
 constexpr uint8_t Memory::bios[256];
@@ -99,7 +98,7 @@ bool Memory::loadRom(std::string const &filename)
 	// For debugging, also try to load a similarly named symbols list file
 	std::filesystem::path symfile = filename;
 	symfile.replace_extension(".sym");
-	tryParseSymbolsFile(symfile);
+	emu->symbols.load(symfile);
 	return true;
 }
 
@@ -110,76 +109,6 @@ void Memory::unloadRom() {
 	}
 }
 
-void Memory::tryParseSymbolsFile(std::string filename)
-{
-	printf("Trying to load symbols file '%s'...\n", filename.c_str());
-
-	// Read sym file
-	try {
-		std::ifstream symFile(filename, std::ios::in);
-
-		// Line elements
-		std::string line, symbol, bankAndAddr, hexBank, hexAddr;
-		uint8_t bank;
-		uint16_t addr;
-
-		size_t symCnt = 0, lineCnt = 0;
-		while (std::getline(symFile, line))
-		{
-			std::istringstream iss(line);
-			try {
-				// Parse bank nr
-				iss >> bankAndAddr;
-
-				hexBank = bankAndAddr.substr(0, bankAndAddr.find(":"));
-				hexAddr = bankAndAddr.substr(bankAndAddr.find(":")+1);
-
-				bank = std::stoi(hexBank, 0, 16);
-				addr = std::stoi(hexAddr, 0, 16);
-
-				// Parse symbol name
-				iss >> symbol;
-
-				// Two-way lookup
-				addrToSymbol[{bank, addr}] = symbol;
-				symbolToAddr[symbol] = {bank, addr};
-
-				symCnt++;
-			} catch (std::exception &e) {
-				// NOP
-			}
-			lineCnt++;
-		}
-		printf("  parsed %d symbols from %d lines \n", symCnt, lineCnt);
-
-
-	} catch (std::exception &e) {
-		printf("  no symbol file or error while parsing symbol file\n");
-	}
-	
-}
-
-std::string Memory::getSymbolFromAddress(uint8_t bank, uint16_t addr)
-{
-	try {
-		return addrToSymbol.at({bank, addr});
-	} catch (std::exception &e) {
-		return "";
-	}
-
-}
-
-// Returns pair of <bank, addr>
-std::pair<uint8_t, uint16_t> Memory::getAddressFromSymbol(uint8_t bank, std::string &symbol)
-{
-	try {
-		return symbolToAddr.at(symbol);
-	} catch (std::exception &e) {
-		return {0, 0};
-	}
-
-}
-
 std::string Memory::getCartridgeTypeString(uint8_t type) {
 
 	switch (type) {
@@ -245,80 +174,112 @@ std::string Memory::getCartridgeRamSizeString(uint8_t size) {
 }
 
 
-std::string Memory::getRegionName(uint16_t addr)
+std::string_view Memory::getRegionName(uint16_t addr)
 {
-	switch (addr & 0xF000) {
-		case 0x0000:
-		case 0x1000:
-		case 0x2000:
-		case 0x3000:
-			if (biosLoaded) {
-				if (addr < 0x0100) {
-					return "BIOS";
-				}
-			}
-			return "ROM0";
+	if (biosLoaded and addr < 0x0100) {
+		return "BIOS";
+	}
+	return memoryRegion(addr).name;
+}
 
-		case 0x4000:
-		case 0x5000:
-		case 0x6000:
-		case 0x7000:
-			return "ROM1"; // TODO bank
+// Copy memory as the CPU would see it with the given bank switched in,
+// straight from the backing arrays. Unlike readByte this never changes
+// state, so the debugger can call it as often as it likes. The bank
+// applies to the switchable ROM and external RAM regions.
+void Memory::peekRange(uint16_t addr, size_t len, int bank, uint8_t *out)
+{
+	while (len > 0) {
+		region_t const &region = memoryRegion(addr);
+		size_t count = std::min(len, (size_t)(region.end - addr + 1));
+		const uint8_t *src = nullptr;
 
-		case 0x8000:
-		case 0x9000:
-			return "VRAM";
+		switch (region.start) {
+			case 0x0000:
+				src = rom + addr;
+				if (biosLoaded and addr < 0x0100) {
+					count = std::min(count, (size_t)(0x0100 - addr));
+					src = bios + addr;
+				}
+				break;
 
-		case 0xA000:
-		case 0xB000:
-			return "EXTRAM";
+			case 0x4000: {
+				size_t romBankNr = bank == MEMORY_BANK_CURRENT ? (mbc == MBC::NONE ? 1 : romBank) : bank;
+				size_t offset = romBankNr * 0x4000 + (addr - 0x4000);
+				if (offset + count <= romLen) {
+					src = rom + offset;
+				}
+				break;
+			}
 
-		case 0xC000:
-		case 0xD000:
-		case 0xE000:
-			return "WRAM";
+			case 0x8000:
+				src = emu->graphics.vram + (addr & 0x1FFF);
+				break;
 
-		case 0xF000:
-			if (addr < 0xFE00) { // Working RAM shadow
-				return "WRAM(S)";
-			}
-			
-			if ((addr & 0x0F00) == 0x0E00) {
-				if (addr < 0xFEA0) {
-					return "OAM";
+			case 0xA000: {
+				size_t ramBankNr = bank == MEMORY_BANK_CURRENT ? (ramSize == 0x03 ? ramBank : 0) : bank;
+				if (ramBankNr < 4) {
+					src = extram + ramBankNr * 0x2000 + (addr & 0x1FFF);
 				}
-				return "UNK?";
+				break;
 			}
-			else {
-				switch (addr & 0xFFF0) {
-					case 0xFF00:
-						return "REGS*";
 
-					case 0xFF40:
-					case 0xFF50:
-					case 0xFF60:
-					case 0xFF70:
-						return "REGS(G)";
+			case 0xC000:
+			case 0xE000:
+				src = workram + (addr & 0x1FFF);
+				break;
 
-					case 0xFF80:
-					case 0xFF90:
-					case 0xFFA0:
-					case 0xFFB0:
-					case 0xFFC0:
-					case 0xFFD0:
-					case 0xFFE0:
-						return "ZERO";
+			case 0xFE00:
+				src = emu->graphics.oam + (addr & 0xFF);
+				break;
 
-					case 0xFFF0:
-						return "REGS(I)";
+			case 0xFF80:
+				src = zeropageram + (addr & 0x7F);
+				break;
+		}
 
-					default:
-						return "UNK?";
-				}
+		if (src) {
+			memcpy(out, src, count);
+		} else if (region.start >= 0xFF00) {
+			for (size_t i = 0; i < count; i++) {
+				out[i] = peekIO(addr + i);
+			}
+		} else {
+			memset(out, 0, count); // unusable, or a bank that doesn't exist
+		}
+
+		out += count;
+		addr += count;
+		len -= count;
+	}
+}
+
+// I/O registers as readByte returns them, without its complaints
+uint8_t Memory::peekIO(uint16_t addr)
+{
+	switch (addr) {
+		case 0xFF00:
+			if (emu->input.wire == 0x10) {
+				return emu->input.row[0];
 			}
-			return "UNK?";
+			if (emu->input.wire == 0x20) {
+				return emu->input.row[1];
+			}
+			return 0;
+
+		case 0xFF04: return emu->cpu.timer.div;
+		case 0xFF05: return emu->cpu.timer.tima;
+		case 0xFF06: return emu->cpu.timer.tma;
+		case 0xFF07: return emu->cpu.timer.tac;
+		case 0xFF0F: return emu->cpu.intFlags;
+		case 0xFFFF: return emu->cpu.ints;
+
+		case 0xFF40: case 0xFF41: case 0xFF42: case 0xFF43: case 0xFF44:
+		case 0xFF45: case 0xFF48: case 0xFF49: case 0xFF4A: case 0xFF4B:
+			return emu->graphics.readByte(addr - 0xFF40);
+
+		default:
+			return 0;
 	}
-	return "UNK?";
 }
 
 uint8_t Memory::readByte(uint16_t addr)
@@ -365,7 +326,7 @@ uint8_t Memory::readByte(uint16_t addr)
 		case 0xA000:
 		case 0xB000:
 			if (!ramEnabled) {
-				printf("Read from disabled external RAM.\n");
+				LOG(emu, WARN, "Read from disabled external RAM.");
 			}
 
 			if (mbc == MBC::NONE) {
@@ -385,7 +346,7 @@ uint8_t Memory::readByte(uint16_t addr)
 					return extram[addr & 0x1FFF] & 0x0F;
 				}
 				else {
-					printf("Read from MBC2 RAM outside limit.\n");
+					LOG(emu, WARN, "Read from MBC2 RAM outside limit.");
 				}
 			}
 			else if (mbc == MBC::MBC3) {
@@ -465,7 +426,7 @@ uint8_t Memory::readByte(uint16_t addr)
 			}
 		
 	}
-	printf("Memory error! 0x%02X\n", addr);
+	LOG(emu, ERROR, "Memory error! 0x%02X", addr);
 	return 0;
 }
 
@@ -483,7 +444,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 			if (mbc == MBC::NONE) {
 				if (biosLoaded) {
 					if (addr < 0x0100) {
-						printf("Writing to BIOS!\n");
+						LOG(emu, WARN, "Writing to BIOS!");
 						//bios[addr] = b;
 						return;
 					}
@@ -504,7 +465,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 					ramEnabled = ((b & 0xF) == 0xA);
 				}
 				else {
-					printf("MBC2 RAM enable with wrong bit.\n");
+					LOG(emu, WARN, "MBC2 RAM enable with wrong bit.");
 				}
 			}
 			break;
@@ -533,7 +494,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 					romBank = (b & 0x0F);
 				}
 				else {
-					printf("MBC2 ROM bank select with wrong bit.\n");
+					LOG(emu, WARN, "MBC2 ROM bank select with wrong bit.");
 				}
 			}
 			else if (mbc == MBC::MBC3) {
@@ -580,7 +541,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 					rtcReg = b;
 				}
 				else {
-					printf("invalid selector written (MBC3) (%x)\n", b);
+					LOG(emu, WARN, "invalid selector written (MBC3) (%x)", b);
 				}
 			}
 			return;
@@ -596,7 +557,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 				bankMode = (b & 0x1);
 			}
 			else if (mbc == MBC::MBC3) {
-				printf("TODO: latch RTC time");
+				LOG(emu, INFO, "TODO: latch RTC time");
 			}
 			return;
 			
@@ -610,14 +571,14 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 
 			//	printRegisters();
 			//}
-			emu->graphics.updateTile(b, addr & 0x1FFE);
+			emu->graphics.updateTile(b, addr & 0x1FFF);
 			return;
 			
 		// External RAM
 		case 0xA000:
 		case 0xB000:
 			if (!ramEnabled)
-				printf("Write to disabled external RAM.\n");
+				LOG(emu, WARN, "Write to disabled external RAM.");
 
 			if (mbc == MBC::NONE) {
 				extram[addr & 0x1FFF] = b;
@@ -636,7 +597,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 					extram[addr & 0x1FFF] = (b & 0x0F);
 				}
 				else {
-					printf("Write to MBC2 RAM outside limit.\n");
+					LOG(emu, WARN, "Write to MBC2 RAM outside limit.");
 				}
 			}
 			else if (mbc == MBC::MBC3) {
@@ -656,7 +617,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 				}
 			}
 			else {
-				printf("0xA000-0xBFFF unimplemented else, TODO\n");
+				LOG(emu, WARN, "0xA000-0xBFFF unimplemented else, TODO");
 			}
 
 			return;
@@ -666,11 +627,13 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 		case 0xD000:
 		case 0xE000:
 			workram[addr & 0x1FFF] = b;
+			emu->disassembly.codeWritten(addr);
 			return;
 			
 		case 0xF000:
 			if (addr < 0xFE00) { // Working RAM shadow
 				workram[addr & 0x1FFF] = b;
+				emu->disassembly.codeWritten(addr);
 				return;
 			}
 			if ((addr & 0x0F00) == 0x0E00) {
@@ -692,6 +655,7 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 				}
 				else if (addr >= 0xFF80) { // Zero page
 					zeropageram[addr & 0x7F] = b;
+					emu->disassembly.codeWritten(addr);
 					return;
 				}
 				else if (addr >= 0xFF40) { // I/O
@@ -723,11 +687,8 @@ void Memory::writeByte(uint8_t b, uint16_t addr)
 					emu->input.wire = b & 0x30;
 					return;
 				}
-				else if (addr >= 0xFF10 && addr <= 0xFF26) {
+				else if ((addr >= 0xFF10 && addr <= 0xFF26) || (addr >= 0xFF30 && addr <= 0xFF3F)) {
 					emu->audio.writeByte(b, addr);
-				}
-				else if (addr >= 0xFF30 && addr <= 0xFF3F) {
-					emu->audio.waveRam[addr - 0xFF30] = b;
 				}			
 			}
 	}
@@ -742,7 +703,7 @@ void Memory::writeWord(uint16_t w, uint16_t addr)
 void Memory::dumpToFile(std::string const &filename) {
 	std::ofstream outFile(filename, std::ofstream::binary);
 	
-	for (int i = 0; i < 0xFFFF; ++i) {
-		outFile << readByte(i);
-	}
+	uint8_t dump[0x10000];
+	peekRange(0x0000, sizeof(dump), MEMORY_BANK_CURRENT, dump);
+	outFile.write((const char *)dump, 0xFFFF);
 }
@@ -4,10 +4,43 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
-#include <map>
+#include <string_view>
 struct Dromaius;
 
 #define MEMORY_MAX_SYMBOL_SIZE 100
+#define MEMORY_BANK_CURRENT    -1 // peek whatever bank is mapped in
+
+// Address space layout, for the debugger
+typedef struct region_s {
+	uint16_t start;
+	uint16_t end; // inclusive
+	std::string_view name;
+} region_t;
+
+static constexpr region_t memoryRegions[] = {
+	{0x0000, 0x3FFF, "ROM0"},
+	{0x4000, 0x7FFF, "ROM1"},
+	{0x8000, 0x9FFF, "VRAM"},
+	{0xA000, 0xBFFF, "EXTRAM"},
+	{0xC000, 0xDFFF, "WRAM"},
+	{0xE000, 0xFDFF, "WRAM(S)"},
+	{0xFE00, 0xFE9F, "OAM"},
+	{0xFEA0, 0xFEFF, "UNK?"},
+	{0xFF00, 0xFF3F, "REGS*"},
+	{0xFF40, 0xFF7F, "REGS(G)"},
+	{0xFF80, 0xFFFE, "ZERO"},
+	{0xFFFF, 0xFFFF, "REGS(I)"},
+};
+
+constexpr region_t const &memoryRegion(uint16_t addr)
+{
+	for (auto const &region : memoryRegions) {
+		if (addr <= region.end) {
+			return region;
+		}
+	}
+	return memoryRegions[0]; // not reached, the table covers everything
+}
 
 struct Memory
 {
@@ -79,7 +112,7 @@ struct Memory
 	size_t ramSize;
 
 	uint8_t workram[0x2000]; // 8kb
-	uint8_t extram[0x2000];
+	uint8_t extram[0x8000]; // up to 4 banks of 8kb
 	uint8_t zeropageram[128];
 
 	bool ramEnabled;
@@ -94,11 +127,6 @@ struct Memory
 	bool romLoaded = false;
 	bool biosLoaded = true;
 
-	// map<<pageNr, addr>, symbol>
-	std::map<std::pair<uint8_t, uint16_t>, std::string> addrToSymbol;
-	// map<symbol, <pageNr, addr>>
-	std::map<std::string, std::pair<uint8_t, uint16_t>> symbolToAddr;
-
 	~Memory();
 
 	// TODO: operator[]() overload?
@@ -108,7 +136,10 @@ struct Memory
 	void writeByte(uint8_t b, uint16_t addr);
 	void writeWord(uint16_t w, uint16_t addr);
 
-	std::string getRegionName(uint16_t addr);
+	// Debugger access: no side effects, any bank
+	std::string_view getRegionName(uint16_t addr);
+	void peekRange(uint16_t addr, size_t len, int bank, uint8_t *out);
+	uint8_t peekIO(uint16_t addr);
 	std::string getCartridgeTypeString(uint8_t type);
 	std::string getCartridgeRomSizeString(uint8_t size);
 	std::string getCartridgeRamSizeString(uint8_t size);
@@ -116,11 +147,6 @@ struct Memory
 
 
 	void dumpToFile(std::string const &filename);
-	void tryParseSymbolsFile(std::string filename);
-
-
-	std::string getSymbolFromAddress(uint8_t bank, uint16_t addr);
-	std::pair<uint8_t, uint16_t> getAddressFromSymbol(uint8_t bank, std::string &symbol);
 
 	bool loadRom(std::string const &filename);
 	void unloadRom();
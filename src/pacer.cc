@@ -0,0 +1,106 @@
+#include <ctime>
+#include <algorithm>
+#include "dromaius.h"
+
+void Pacer::initialize()
+{
+	frequency = SDL_GetPerformanceFrequency();
+	resync(1);
+}
+
+// Start a new timeline at the current time
+void Pacer::resync(int speed)
+{
+	this->speed = speed;
+	start = SDL_GetPerformanceCounter();
+	frames = 0;
+	audioStart = emu->samplesPlayed;
+	audioCorrection = 0;
+}
+
+uint64_t Pacer::frameDue(uint64_t frame)
+{
+	// 128 bit intermediate, frame * frequency * 70224 overflows 64 bits in weeks
+	unsigned __int128 ticks = (unsigned __int128)frame * frequency * GB_CLOCKS_PER_FRAME;
+	return start + audioCorrection + (uint64_t)(ticks / ((uint64_t)GB_CLOCK_RATE * speed));
+}
+
+// How far the emulation runs behind the next frame's due time
+int64_t Pacer::lagMicros()
+{
+	int64_t ticks = (int64_t)(SDL_GetPerformanceCounter() - frameDue(frames));
+	return ticks * 1000000 / (int64_t)frequency;
+}
+
+// Called once per emulated frame. Speed is a multiplier, 0 doesn't wait.
+void Pacer::waitForFrame(int speed)
+{
+	if (speed != this->speed) {
+		resync(speed);
+	}
+	if (speed == 0) {
+		return;
+	}
+
+	frames++;
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	if (emu->settings.audioSync and speed == 1 and emu->audio.initialized and emu->audio.dev) {
+		followAudioClock(now);
+	}
+
+	uint64_t due = frameDue(frames);
+	if (now >= due) {
+		// Too far behind to catch up without a burst of frames, start over
+		if (now - due > MAX_FRAMESKIP * frequency * GB_CLOCKS_PER_FRAME / GB_CLOCK_RATE) {
+			resync(speed);
+		}
+		return;
+	}
+
+	sleepUntil(due, now);
+}
+
+// Sleep for most of the time, then spin the last bit for precision. Takes
+// the counter value the caller checked, so due - now can't wrap around.
+void Pacer::sleepUntil(uint64_t due, uint64_t now)
+{
+	const uint64_t spin = frequency / 1000; // 1 ms
+
+	if (now >= due) {
+		return;
+	}
+	if (due - now > spin) {
+		uint64_t ns = (due - now - spin) * 1000000000 / frequency;
+#ifdef __linux__
+		struct timespec ts;
+		ts.tv_sec = ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, nullptr);
+#else
+		SDL_Delay(ns / 1000000);
+#endif
+	}
+
+	while (SDL_GetPerformanceCounter() < due) {
+		// spin
+	}
+}
+
+// The sound card's crystal and the performance counter never agree
+// exactly. Nudge the timeline towards the audio device's notion of
+// elapsed time, a little per frame so callback jitter averages out.
+void Pacer::followAudioClock(uint64_t now)
+{
+	uint32_t samples = emu->samplesPlayed - audioStart;
+	if (samples == 0 or emu->audio.have.freq <= 0) {
+		return;
+	}
+
+	int64_t audioTicks = (int64_t)((uint64_t)samples * frequency / emu->audio.have.freq);
+	int64_t hostTicks = (int64_t)(now - start - audioCorrection);
+	int64_t drift = hostTicks - audioTicks; // positive: audio plays slower
+
+	int64_t limit = (int64_t)frequency / 2000; // 0.5 ms per frame
+	audioCorrection += std::clamp(drift / 16, -limit, limit);
+}
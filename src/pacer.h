@@ -0,0 +1,36 @@
+#ifndef INCLUDED_PACER_H
+#define INCLUDED_PACER_H
+
+#include <cstdint>
+struct Dromaius;
+
+// Keeps emulated frames in step with real time: 70224 clocks per frame at
+// 4194304 Hz, which is 59.7275 frames per second. Due times are computed
+// from the frame count since the last resync, so rounding never adds up.
+struct Pacer
+{
+	// Up-reference
+	Dromaius *emu;
+
+	uint64_t frequency; // performance counter ticks per second
+	uint64_t start; // counter value at the last resync
+	uint64_t frames; // frames paced since then
+	int speed; // multiplier the current timeline runs at
+
+	// Audio clock slaving
+	uint32_t audioStart; // samples played at the last resync
+	int64_t audioCorrection; // counter ticks added to keep up with the audio device
+
+	void initialize();
+	void resync(int speed);
+
+	uint64_t frameDue(uint64_t frame);
+	int64_t lagMicros();
+	void waitForFrame(int speed);
+
+private:
+	void sleepUntil(uint64_t due, uint64_t now);
+	void followAudioClock(uint64_t now);
+};
+
+#endif
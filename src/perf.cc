@@ -0,0 +1,86 @@
+#include <cstring>
+#include <algorithm>
+#include "dromaius.h"
+
+void Perf::initialize()
+{
+	frequency = SDL_GetPerformanceFrequency();
+	memset(&emulation, 0, sizeof(emulation));
+	memset(&display, 0, sizeof(display));
+	start(emulation);
+	start(display);
+}
+
+// Measure the next frame from now, leaves the finished ones alone
+void Perf::start(ring_t &ring)
+{
+	memset(&ring.current, 0, sizeof(ring.current));
+	ring.lastEnd = SDL_GetPerformanceCounter();
+}
+
+const char *Perf::stageName(uint8_t stage)
+{
+	static const char *names[] = {"CPU", "PPU", "APU", "GUI", "Present", "Sleep"};
+	return stage < STAGE_COUNT ? names[stage] : "?";
+}
+
+void Perf::endFrame(ring_t &ring)
+{
+	uint64_t now = SDL_GetPerformanceCounter();
+	sample_t &sample = ring.current;
+	sample.interval = now - ring.lastEnd;
+	ring.lastEnd = now;
+
+	// The PPU and APU run inside the CPU's timer
+	uint64_t nested = sample.ticks[PPU] + sample.ticks[APU];
+	sample.ticks[CPU] -= std::min(sample.ticks[CPU], nested);
+
+	ring.samples[ring.next] = sample;
+	ring.next = (ring.next + 1) % PERF_HISTORY;
+	ring.count = std::min(ring.count + 1, (size_t)PERF_HISTORY);
+	memset(&sample, 0, sizeof(sample));
+}
+
+void Perf::summarize(ring_t const &ring, summary_t &summary) const
+{
+	memset(&summary, 0, sizeof(summary));
+	summary.frames = ring.count;
+	if (ring.count == 0) {
+		return;
+	}
+
+	uint64_t ticks[STAGE_COUNT] = {};
+	uint64_t interval = 0, instructions = 0, cycles = 0;
+	double busy[PERF_HISTORY];
+	for (size_t i = 0; i < ring.count; i++) {
+		sample_t const &sample = ring.samples[i];
+		for (int stage = 0; stage < STAGE_COUNT; stage++) {
+			ticks[stage] += sample.ticks[stage];
+		}
+		interval += sample.interval;
+		instructions += sample.instructions;
+		cycles += sample.cycles;
+		busy[i] = (sample.interval - std::min(sample.interval, sample.ticks[SLEEP])) * 1000.0 / frequency;
+	}
+
+	double frames = ring.count;
+	summary.seconds = (double)interval / frequency;
+	if (summary.seconds > 0) {
+		summary.fps = frames / summary.seconds;
+		summary.speed = cycles * 4.0 / GB_CLOCK_RATE / summary.seconds;
+		summary.instructionsPerSecond = instructions / summary.seconds;
+	}
+	summary.cyclesPerFrame = cycles / frames;
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		summary.stageMs[stage] = ticks[stage] * 1000.0 / frequency / frames;
+	}
+	summary.frameMs = summary.seconds * 1000.0 / frames;
+	summary.busyMs = summary.frameMs - summary.stageMs[SLEEP];
+
+	static const double ranks[] = {0.5, 0.9, 0.99, 1.0};
+	for (int i = 0; i < 4; i++) {
+		size_t rank = std::min((size_t)(ranks[i] * ring.count), ring.count - 1);
+		std::nth_element(busy, busy + rank, busy + ring.count);
+		summary.busyPercentile[i] = busy[rank];
+	}
+}
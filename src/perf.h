@@ -0,0 +1,84 @@
+#ifndef INCLUDED_PERF_H
+#define INCLUDED_PERF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <SDL2/SDL.h>
+struct Dromaius;
+
+#define PERF_HISTORY 300 // frames, about 5 seconds
+
+// Where the host's time goes, per emulated frame on the emulation thread
+// and per displayed frame on the GUI thread. Timers read the performance
+// counter, so they go around stages and scanlines, never instructions.
+struct Perf
+{
+	enum Stage : uint8_t {
+		CPU, // the emulation work not taken by the stages below
+		PPU, // rendering scanlines and handing over frames
+		APU,
+		GUI, // building the GUI
+		PRESENT, // texture upload, drawing and swapping
+		SLEEP, // waiting for the next frame
+		STAGE_COUNT
+	};
+
+	typedef struct sample_s {
+		uint64_t ticks[STAGE_COUNT];
+		uint64_t interval; // ticks since the previous frame ended
+		uint32_t instructions;
+		uint32_t cycles; // CPU m-cycles
+	} sample_t;
+
+	// The frame being measured and the latest finished ones
+	typedef struct ring_s {
+		sample_t current;
+		sample_t samples[PERF_HISTORY];
+		size_t next;
+		size_t count;
+		uint64_t lastEnd;
+	} ring_t;
+
+	// Averages over a ring, times in ms
+	typedef struct summary_s {
+		size_t frames;
+		double seconds;
+		double fps;
+		double speed; // emulated time per real time, 1.0 = full speed
+		double instructionsPerSecond;
+		double cyclesPerFrame;
+		double stageMs[STAGE_COUNT];
+		double frameMs; // interval
+		double busyMs; // interval less sleep
+		double busyPercentile[4]; // 50th, 90th, 99th, max
+	} summary_t;
+
+	// Adds the time until it goes out of scope to a stage
+	struct Timer {
+		uint64_t &ticks;
+		uint64_t start;
+
+		Timer(sample_t &sample, Stage stage) : ticks(sample.ticks[stage]), start(SDL_GetPerformanceCounter()) {}
+		~Timer() { ticks += SDL_GetPerformanceCounter() - start; }
+	};
+
+	// Up-reference
+	Dromaius *emu;
+
+	uint64_t frequency; // performance counter ticks per second
+
+	// Written by the emulation thread while holding stateMutex, except
+	// for the current sample
+	ring_t emulation;
+
+	// Only touched by the GUI thread
+	ring_t display;
+
+	void initialize();
+	void start(ring_t &ring);
+	void endFrame(ring_t &ring);
+	void summarize(ring_t const &ring, summary_t &summary) const;
+	static const char *stageName(uint8_t stage);
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <cstring>
+#include "dromaius.h"
+
+void Profiler::reset()
+{
+	clearStats();
+	clearStack();
+}
+
+void Profiler::clearStats()
+{
+	functions.clear();
+	functionIndex.clear();
+	edges.clear();
+	edgeIndex.clear();
+	for (int i = 0; i < PROFILER_CACHE_SIZE; i++) {
+		functionCache[i].key = UINT64_MAX;
+		edgeCache[i].key = UINT64_MAX;
+	}
+	resyncs = 0;
+	overflows = 0;
+
+	// Frames refer to the functions
+	for (int i = 0; i < depth; i++) {
+		stack[i].function = functionAt(stack[i].bank, stack[i].target);
+		stack[i].edge = i > 0 ? edgeBetween(stack[i - 1].function, stack[i].function) : PROFILER_NONE;
+	}
+}
+
+// Start over from wherever the CPU is now
+void Profiler::clearStack()
+{
+	uint16_t pc = emu->cpu.r.pc;
+	uint8_t bank = emu->symbols.currentBank(pc);
+	unsigned long long now = emu->cpu.c;
+
+	depth = 0;
+	push({0x0000, pc, bank, ENTRY, 0x10000, now, now, functionAt(bank, pc), PROFILER_NONE});
+}
+
+uint32_t Profiler::functionAt(uint8_t bank, uint16_t addr)
+{
+	uint32_t key = (bank << 16) | addr;
+	cached_t &cached = functionCache[(addr ^ (addr >> 8) ^ bank) & (PROFILER_CACHE_SIZE - 1)];
+	if (cached.key == key) {
+		return cached.index;
+	}
+
+	auto [it, added] = functionIndex.try_emplace(key, functions.size());
+	if (added) {
+		functions.push_back({addr, bank, 0, 0, 0, 0, 0, 0, 0});
+	}
+	cached = {key, it->second};
+	return it->second;
+}
+
+uint32_t Profiler::edgeBetween(uint32_t caller, uint32_t callee)
+{
+	uint64_t key = ((uint64_t)caller << 32) | callee;
+	cached_t &cached = edgeCache[(caller * 7 + callee) & (PROFILER_CACHE_SIZE - 1)];
+	if (cached.key == key) {
+		return cached.index;
+	}
+
+	auto [it, added] = edgeIndex.try_emplace(key, edges.size());
+	if (added) {
+		edges.push_back({caller, callee, 0, 0});
+	}
+	cached = {key, it->second};
+	return it->second;
+}
+
+// Charge the running function for the cycles since it last got control
+void Profiler::accrue(unsigned long long now)
+{
+	if (depth == 0) {
+		return;
+	}
+	frame_t &top = stack[depth - 1];
+	function_t &function = functions[top.function];
+	function.selfCycles += now - top.resumed;
+	function.frameSelf += now - top.resumed;
+	top.resumed = now;
+}
+
+void Profiler::push(frame_t const &frame)
+{
+	// Keep the innermost frames when it gets this deep
+	if (depth == PROFILER_STACK_SIZE) {
+		memmove(stack, stack + 1, (PROFILER_STACK_SIZE - 1) * sizeof(frame_t));
+		depth--;
+		overflows++;
+	}
+	stack[depth++] = frame;
+}
+
+void Profiler::pop()
+{
+	unsigned long long now = emu->cpu.c;
+	accrue(now);
+
+	frame_t &frame = stack[--depth];
+	functions[frame.function].cycles += now - frame.entry;
+	if (frame.edge != PROFILER_NONE) {
+		edges[frame.edge].cycles += now - frame.entry;
+	}
+
+	if (depth > 0) {
+		stack[depth - 1].resumed = now;
+	}
+}
+
+void Profiler::call(uint16_t site, uint16_t target, uint16_t sp, Kind kind)
+{
+	// Frames with their return address at or below the new one were left
+	// without returning
+	while (depth > 0 and stack[depth - 1].sp <= sp) {
+		pop();
+		resyncs++;
+	}
+
+	unsigned long long now = emu->cpu.c;
+	accrue(now);
+
+	// The caller's function is kept in its frame
+	uint8_t bank = emu->symbols.currentBank(target);
+	uint32_t function = functionAt(bank, target);
+	uint32_t edge = depth > 0 ? edgeBetween(stack[depth - 1].function, function) : PROFILER_NONE;
+
+	functions[function].calls++;
+	functions[function].frameCalls++;
+	if (edge != PROFILER_NONE) {
+		edges[edge].calls++;
+	}
+
+	push({site, target, bank, kind, sp, now, now, function, edge});
+}
+
+void Profiler::ret(uint16_t sp)
+{
+	// Frames below the return address were left without returning
+	while (depth > 0 and stack[depth - 1].sp < sp) {
+		pop();
+		resyncs++;
+	}
+
+	// Otherwise it returns through an address pushed by hand, a jump
+	if (depth > 0 and stack[depth - 1].sp == sp) {
+		pop();
+	}
+}
+
+void Profiler::endFrame()
+{
+	accrue(emu->cpu.c);
+	for (function_t &function : functions) {
+		function.lastFrameCalls = function.frameCalls;
+		function.lastFrameSelf = function.frameSelf;
+		function.frameCalls = 0;
+		function.frameSelf = 0;
+	}
+}
+
+// Functions and call graph as CSV
+bool Profiler::exportToFile(std::string const &filename)
+{
+	FILE *file = fopen(filename.c_str(), "w");
+	if (not file) {
+		printf("Can't write profile '%s'\n", filename.c_str());
+		return false;
+	}
+
+	char name[64], other[64];
+	fprintf(file, "function,bank,addr,calls,cycles,self cycles,last frame calls,last frame self cycles\n");
+	for (function_t const &function : functions) {
+		emu->symbols.format(name, sizeof(name), function.bank, function.addr);
+		fprintf(file, "%s,%02X,%04X,%llu,%llu,%llu,%u,%llu\n", name, function.bank, function.addr,
+			(unsigned long long)function.calls, (unsigned long long)function.cycles,
+			(unsigned long long)function.selfCycles, function.lastFrameCalls,
+			(unsigned long long)function.lastFrameSelf);
+	}
+
+	fprintf(file, "\ncaller,caller bank,caller addr,callee,callee bank,callee addr,calls,cycles\n");
+	for (edge_t const &edge : edges) {
+		function_t const &caller = functions[edge.caller];
+		function_t const &callee = functions[edge.callee];
+		emu->symbols.format(name, sizeof(name), caller.bank, caller.addr);
+		emu->symbols.format(other, sizeof(other), callee.bank, callee.addr);
+		fprintf(file, "%s,%02X,%04X,%s,%02X,%04X,%llu,%llu\n", name, caller.bank, caller.addr,
+			other, callee.bank, callee.addr, (unsigned long long)edge.calls, (unsigned long long)edge.cycles);
+	}
+
+	fclose(file);
+	printf("Wrote profile to '%s'\n", filename.c_str());
+	return true;
+}
@@ -0,0 +1,102 @@
+#ifndef INCLUDED_PROFILER_H
+#define INCLUDED_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+struct Dromaius;
+
+#define PROFILER_STACK_SIZE 256
+#define PROFILER_NONE UINT32_MAX
+#define PROFILER_CACHE_SIZE 256 // entries per cache, a power of two
+
+// Shadow call stack kept by the CPU on calls, RSTs, interrupts and
+// returns, with call counts and cycles per function and per caller/callee
+// pair. Code that jumps into functions, returns by hand or moves SP
+// would throw a plain stack off, so frames are matched to returns by
+// where their return address is on the stack instead. Cycles are CPU
+// m-cycles.
+struct Profiler
+{
+	enum Kind : uint8_t {
+		ENTRY, // where execution started, never returns
+		CALL,
+		RST,
+		INTERRUPT,
+	};
+
+	typedef struct frame_s {
+		uint16_t site; // call instruction, or the PC that was interrupted
+		uint16_t target;
+		uint8_t bank; // of the target
+		uint8_t kind;
+		uint32_t sp; // where the return address is
+		unsigned long long entry; // cycle
+		unsigned long long resumed; // cycle since which it runs itself
+		uint32_t function; // index into functions
+		uint32_t edge; // index into edges, PROFILER_NONE at the bottom
+	} frame_t;
+
+	typedef struct function_s {
+		uint16_t addr;
+		uint8_t bank;
+		uint64_t calls;
+		uint64_t cycles; // including callees, counted on return
+		uint64_t selfCycles;
+		uint32_t frameCalls; // during the frame being emulated
+		uint64_t frameSelf;
+		uint32_t lastFrameCalls; // during the last complete frame
+		uint64_t lastFrameSelf;
+	} function_t;
+
+	typedef struct edge_s {
+		uint32_t caller;
+		uint32_t callee;
+		uint64_t calls;
+		uint64_t cycles;
+	} edge_t;
+
+	// Up-reference
+	Dromaius *emu;
+
+	frame_t stack[PROFILER_STACK_SIZE];
+	int depth = 0;
+	uint64_t resyncs = 0; // frames found abandoned through SP
+	uint64_t overflows = 0; // bottom frames dropped for lack of room
+
+	std::vector<function_t> functions;
+	std::unordered_map<uint32_t, uint32_t> functionIndex; // by bank << 16 | addr
+	std::vector<edge_t> edges;
+	std::unordered_map<uint64_t, uint32_t> edgeIndex; // by caller << 32 | callee
+
+	// Recently used entries in front of the maps, direct-mapped, so calls
+	// don't hash in the common case. Keys are all ones when empty.
+	typedef struct cached_s {
+		uint64_t key;
+		uint32_t index;
+	} cached_t;
+	cached_t functionCache[PROFILER_CACHE_SIZE];
+	cached_t edgeCache[PROFILER_CACHE_SIZE];
+
+	void reset();
+	void clearStats();
+	void clearStack();
+
+	// From the CPU, sp is where the return address is
+	void call(uint16_t site, uint16_t target, uint16_t sp, Kind kind);
+	void ret(uint16_t sp);
+	void endFrame();
+
+	bool exportToFile(std::string const &filename);
+
+private:
+	uint32_t functionAt(uint8_t bank, uint16_t addr);
+	uint32_t edgeBetween(uint32_t caller, uint32_t callee);
+	void push(frame_t const &frame);
+	void pop();
+	void accrue(unsigned long long now);
+};
+
+#endif
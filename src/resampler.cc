@@ -0,0 +1,98 @@
+#include <cstring>
+#include <cmath>
+#include "resampler.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static const int qualityTaps[Resampler::QUALITY_COUNT] = {16, 32, 64};
+
+void Resampler::initialize(uint32_t inRate, uint32_t outRate, uint8_t quality)
+{
+	this->inRate = inRate;
+	this->outRate = outRate;
+	this->quality = quality;
+	taps = qualityTaps[quality];
+
+	pos = 0;
+	step = baseStep = ((uint64_t)inRate << 32) / outRate;
+	buffered = 0;
+	memset(buffer, 0, sizeof(buffer));
+	memset(kernel, 0, sizeof(kernel));
+
+	// Lowpass below the lower of both Nyquist rates, relative to the input
+	double cutoff = 0.9 * (outRate < inRate ? (double)outRate / inRate : 1.0);
+
+	// One extra phase, so interpolation at the last phase has a neighbour
+	for (int p = 0; p <= RESAMPLER_PHASES; p++) {
+		double sum = 0;
+		for (int i = 0; i < taps; i++) {
+			// Distance from the output position, centered in the kernel
+			double x = i - (taps / 2 - 1) - (double)p / RESAMPLER_PHASES;
+			double sinc = x == 0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+
+			// Blackman window over the kernel width
+			double w = (x + taps / 2.0) / taps;
+			double window = 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+
+			kernel[p][i] = sinc * window;
+			sum += kernel[p][i];
+		}
+		for (int i = 0; i < taps; i++) {
+			kernel[p][i] /= sum;
+		}
+	}
+}
+
+void Resampler::setRateScale(double scale)
+{
+	step = baseStep / scale;
+}
+
+static inline float dot(const float *a, const float *b, int n)
+{
+#ifdef __SSE__
+	__m128 sum = _mm_setzero_ps();
+	for (int i = 0; i < n; i += 4) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_load_ps(b + i)));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+#else
+	float sum = 0;
+	for (int i = 0; i < n; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+#endif
+}
+
+size_t Resampler::process(const float *in, size_t count, float *out)
+{
+	// Append after the samples kept from last time
+	memcpy(buffer + buffered, in, count * sizeof(float));
+	buffered += count;
+
+	size_t produced = 0;
+	while ((pos >> 32) + taps <= buffered) {
+		const float *src = buffer + (pos >> 32);
+		uint32_t frac = (uint32_t)pos;
+		uint32_t phase = frac >> (32 - RESAMPLER_PHASE_BITS);
+		float f = (uint32_t)(frac << RESAMPLER_PHASE_BITS) * (1.0f / 4294967296.0f);
+
+		float a = dot(src, kernel[phase], taps);
+		float b = dot(src, kernel[phase + 1], taps);
+		out[produced++] = a + (b - a) * f;
+
+		pos += step;
+	}
+
+	// Keep what the next outputs still need
+	size_t consumed = pos >> 32;
+	memmove(buffer, buffer + consumed, (buffered - consumed) * sizeof(float));
+	buffered -= consumed;
+	pos -= (uint64_t)consumed << 32;
+
+	return produced;
+}
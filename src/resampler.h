@@ -0,0 +1,48 @@
+#ifndef INCLUDED_RESAMPLER_H
+#define INCLUDED_RESAMPLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "blip.h"
+
+#define RESAMPLER_PHASE_BITS 6
+#define RESAMPLER_PHASES     (1 << RESAMPLER_PHASE_BITS)
+#define RESAMPLER_MAX_TAPS   64 // a multiple of 4 for SIMD
+
+// Polyphase FIR converting the APU's native rate to the device rate.
+// Each output sample is the dot product of the input around its position
+// with the two nearest kernel phases, interpolated. More taps give a
+// steeper lowpass at a higher cost per sample.
+// Plain arrays only, so it can be part of a savestate.
+struct Resampler
+{
+	enum Quality {
+		FAST,   // 16 taps
+		NORMAL, // 32 taps
+		BEST,   // 64 taps
+		QUALITY_COUNT
+	};
+
+	uint32_t inRate;
+	uint32_t outRate;
+	uint8_t quality;
+	int taps;
+
+	uint64_t pos;  // next output position in the buffer, 32.32 fixed point
+	uint64_t step; // input samples per output sample, 32.32 fixed point
+	uint64_t baseStep; // step for the nominal rates
+	size_t buffered;
+	alignas(16) float buffer[RESAMPLER_MAX_TAPS + BLIP_BUFFER_SIZE];
+	alignas(16) float kernel[RESAMPLER_PHASES + 1][RESAMPLER_MAX_TAPS];
+
+	void initialize(uint32_t inRate, uint32_t outRate, uint8_t quality);
+
+	// Scale the output rate slightly, 1.01 produces 1% more samples
+	void setRateScale(double scale);
+
+	// Converts up to BLIP_BUFFER_SIZE input samples, returns the number
+	// written to out, which needs room for count * outRate / inRate + 1
+	size_t process(const float *in, size_t count, float *out);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef INCLUDED_SETTINGS_H
+#define INCLUDED_SETTINGS_H
+
+#include <cstdint>
+
+typedef struct keymap_s {
+	int start;
+	int startDown;
+
+	int select;
+	int selectDown;
+
+	int left;
+	int leftDown;
+
+	int up;
+	int upDown;
+
+	int right;
+	int rightDown;
+
+	int down;
+	int downDown;
+
+	int b;
+	int bDown;
+
+	int a;
+	int aDown;
+} keymap_t;
+
+
+typedef struct settings_s {
+	int debug;
+	keymap_t keymap;
+	uint32_t palette[4]; // RGBA color per shade, lightest first
+	int frameSkip; // draw 1 of every frameSkip frames, 0 = skip when behind
+	int turboSpeed; // speed multiplier while fast-forwarding, 0 = uncapped
+	bool turboMute; // silence audio while fast-forwarding
+	bool audioSync; // pace emulation by the audio device clock
+	int audioQuality; // Resampler::Quality, native to device rate conversion
+	int audioLatency; // ms of audio kept queued for the device
+	int logLevel; // Logger::Level, lower ones are dropped
+	bool logToFile; // also append the log to LOG_FILENAME
+} settings_t;
+
+#endif
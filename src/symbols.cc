@@ -0,0 +1,321 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <charconv>
+#include <algorithm>
+#include "dromaius.h"
+
+static bool isSpace(char c)
+{
+	return c == ' ' or c == '\t' or c == '\r';
+}
+
+static char lower(char c)
+{
+	return c >= 'A' and c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Character class for the trigram index
+static uint32_t fold(char c)
+{
+	c = lower(c);
+	if (c >= 'a' and c <= 'z') {
+		return c - 'a';
+	}
+	if (c >= '0' and c <= '9') {
+		return 26 + c - '0';
+	}
+	return c == '_' ? 36 : c == '.' ? 37 : 38;
+}
+
+static uint32_t gramAt(std::string_view s, size_t i)
+{
+	return (fold(s[i]) * SYMBOLS_GRAM_CHARS + fold(s[i + 1])) * SYMBOLS_GRAM_CHARS + fold(s[i + 2]);
+}
+
+bool Symbols::load(std::string const &filename)
+{
+	printf("Trying to load symbols file '%s'...\n", filename.c_str());
+	clear();
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (not file) {
+		printf("  no symbol file\n");
+		return false;
+	}
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	pool = contents.str();
+
+	// Parse "bank:addr name" lines, skip anything else
+	size_t lineCnt = 0;
+	const char *p = pool.data();
+	const char *end = p + pool.size();
+	while (p < end) {
+		const char *eol = std::find(p, end, '\n');
+		lineCnt++;
+
+		while (p < eol and isSpace(*p)) {
+			p++;
+		}
+
+		unsigned bank = 0, addr = 0;
+		auto [bankEnd, bankErr] = std::from_chars(p, eol, bank, 16);
+		if (bankErr == std::errc() and bankEnd < eol and *bankEnd == ':' and bank < SYMBOLS_BANKS) {
+			auto [addrEnd, addrErr] = std::from_chars(bankEnd + 1, eol, addr, 16);
+			if (addrErr == std::errc() and addr <= 0xFFFF and addrEnd < eol and isSpace(*addrEnd)) {
+				const char *name = addrEnd;
+				while (name < eol and isSpace(*name)) {
+					name++;
+				}
+				const char *nameEnd = name;
+				while (nameEnd < eol and not isSpace(*nameEnd) and *nameEnd != ';') {
+					nameEnd++;
+				}
+				if (nameEnd > name) {
+					byName.push_back({(uint16_t)addr, (uint8_t)bank, std::string_view(name, nameEnd - name)});
+				}
+			}
+		}
+
+		p = eol + 1;
+	}
+
+	for (symbol_t const &symbol : byName) {
+		byAddr[symbol.bank].push_back(symbol);
+	}
+	for (auto &symbols : byAddr) {
+		std::stable_sort(symbols.begin(), symbols.end(),
+			[](symbol_t const &a, symbol_t const &b) { return a.addr < b.addr; });
+	}
+	std::stable_sort(byName.begin(), byName.end(),
+		[](symbol_t const &a, symbol_t const &b) { return a.name < b.name; });
+	buildSearchIndex();
+
+	printf("  parsed %zu symbols from %zu lines\n", byName.size(), lineCnt);
+	return true;
+}
+
+void Symbols::clear()
+{
+	for (auto &symbols : byAddr) {
+		symbols.clear();
+	}
+	byName.clear();
+	pool.clear();
+	folded.clear();
+	foldedStart.clear();
+	foldedOrder.clear();
+	gramStart.assign(SYMBOLS_GRAMS + 1, 0);
+	gramNames.clear();
+	gramHits.clear();
+}
+
+uint8_t Symbols::currentBank(uint16_t addr)
+{
+	Memory &memory = emu->memory;
+	if (addr >= 0x4000 and addr < 0x8000) {
+		return memory.mbc == Memory::MBC::NONE ? 1 : memory.romBank;
+	}
+	if (addr >= 0xA000 and addr < 0xC000) {
+		return memory.ramBank;
+	}
+	return 0;
+}
+
+// With several symbols at one address, the first one in the file wins
+std::string_view Symbols::name(uint8_t bank, uint16_t addr) const
+{
+	auto const &symbols = byAddr[bank];
+	auto it = std::lower_bound(symbols.begin(), symbols.end(), addr,
+		[](symbol_t const &symbol, uint16_t addr) { return symbol.addr < addr; });
+	return it != symbols.end() and it->addr == addr ? it->name : std::string_view();
+}
+
+const Symbols::symbol_t *Symbols::find(std::string_view name) const
+{
+	auto it = std::lower_bound(byName.begin(), byName.end(), name,
+		[](symbol_t const &symbol, std::string_view name) { return symbol.name < name; });
+	return it != byName.end() and it->name == name ? &*it : nullptr;
+}
+
+const Symbols::symbol_t *Symbols::nearest(uint8_t bank, uint16_t addr) const
+{
+	auto const &symbols = byAddr[bank];
+	auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+		[](uint16_t addr, symbol_t const &symbol) { return addr < symbol.addr; });
+	if (it == symbols.begin()) {
+		return nullptr;
+	}
+
+	// Bank 0 holds ROM0 and all RAM, a symbol in another region isn't it
+	uint16_t at = (it - 1)->addr;
+	if (memoryRegion(at).start != memoryRegion(addr).start) {
+		return nullptr;
+	}
+
+	// First of the symbols at that address
+	it = std::lower_bound(symbols.begin(), it, at,
+		[](symbol_t const &symbol, uint16_t addr) { return symbol.addr < addr; });
+	return &*it;
+}
+
+int Symbols::format(char *buf, size_t len, uint8_t bank, uint16_t addr) const
+{
+	const symbol_t *symbol = nearest(bank, addr);
+	if (not symbol) {
+		if (len) {
+			buf[0] = '\0';
+		}
+		return 0;
+	}
+	if (symbol->addr == addr) {
+		return snprintf(buf, len, "%.*s", (int)symbol->name.size(), symbol->name.data());
+	}
+	return snprintf(buf, len, "%.*s+%X", (int)symbol->name.size(), symbol->name.data(), addr - symbol->addr);
+}
+
+// Counting sort of (trigram, name) pairs, so each list comes out ascending
+void Symbols::buildSearchIndex()
+{
+	folded.clear();
+	foldedStart.clear();
+	for (symbol_t const &symbol : byName) {
+		foldedStart.push_back(folded.size());
+		std::transform(symbol.name.begin(), symbol.name.end(), std::back_inserter(folded), lower);
+	}
+	foldedStart.push_back(folded.size());
+
+	foldedOrder.resize(byName.size());
+	for (uint32_t i = 0; i < byName.size(); i++) {
+		foldedOrder[i] = i;
+	}
+	std::sort(foldedOrder.begin(), foldedOrder.end(), [this](uint32_t a, uint32_t b) {
+		return std::string_view(folded.data() + foldedStart[a], foldedStart[a + 1] - foldedStart[a])
+			< std::string_view(folded.data() + foldedStart[b], foldedStart[b + 1] - foldedStart[b]);
+	});
+
+	// Trigrams per name, a name's repeats only count once
+	std::vector<uint32_t> grams, nameEnd;
+	for (symbol_t const &symbol : byName) {
+		size_t first = grams.size();
+		for (size_t i = 0; i + 3 <= symbol.name.size(); i++) {
+			uint32_t gram = gramAt(symbol.name, i);
+			if (std::find(grams.begin() + first, grams.end(), gram) == grams.end()) {
+				grams.push_back(gram);
+			}
+		}
+		nameEnd.push_back(grams.size());
+	}
+
+	gramStart.assign(SYMBOLS_GRAMS + 1, 0);
+	for (uint32_t gram : grams) {
+		gramStart[gram + 1]++;
+	}
+	for (size_t gram = 0; gram < SYMBOLS_GRAMS; gram++) {
+		gramStart[gram + 1] += gramStart[gram];
+	}
+
+	gramNames.resize(grams.size());
+	std::vector<uint32_t> fill(gramStart.begin(), gramStart.end() - 1);
+	for (size_t i = 0, g = 0; i < byName.size(); i++) {
+		for (; g < nameEnd[i]; g++) {
+			gramNames[fill[grams[g]]++] = i;
+		}
+	}
+
+	gramHits.assign(byName.size(), 0);
+}
+
+// Names sharing enough trigrams with the query are candidates, so a typo
+// only costs a few. Ranked by shared trigrams, then whether the query
+// appears as is, preferably at the start, then by shortness. Queries too
+// short for trigrams only match the start of names.
+size_t Symbols::search(std::string_view query, uint32_t *results, size_t max)
+{
+	if (query.empty() or max == 0 or byName.empty()) {
+		return 0;
+	}
+
+	char lowered[64];
+	size_t len = std::min(query.size(), sizeof(lowered));
+	std::transform(query.begin(), query.begin() + len, lowered, lower);
+	std::string_view q(lowered, len);
+
+	auto foldedName = [this](uint32_t index) {
+		return std::string_view(folded.data() + foldedStart[index], foldedStart[index + 1] - foldedStart[index]);
+	};
+
+	size_t count = 0;
+	std::vector<int> scores(max);
+	auto consider = [&](uint32_t index, int hits) {
+		std::string_view name = foldedName(index);
+		int score = hits * 16 - (int)std::min(name.size(), (size_t)32);
+
+		// Skip the text match if even the best outcome wouldn't make the list
+		if (count == max and score + 64 <= scores[max - 1]) {
+			return;
+		}
+		size_t pos = name.find(q);
+		if (pos == 0) {
+			score += 64;
+		} else if (pos != std::string_view::npos) {
+			score += 32;
+		} else if (hits == 0) {
+			return; // short queries must match as is
+		}
+
+		// Insert, keeping the best max
+		size_t at = count;
+		while (at > 0 and scores[at - 1] < score) {
+			at--;
+		}
+		if (at == max) {
+			return;
+		}
+		count = std::min(count + 1, max);
+		for (size_t i = count - 1; i > at; i--) {
+			scores[i] = scores[i - 1];
+			results[i] = results[i - 1];
+		}
+		scores[at] = score;
+		results[at] = index;
+	};
+
+	if (q.size() < 3) {
+		auto first = std::lower_bound(foldedOrder.begin(), foldedOrder.end(), q,
+			[&](uint32_t index, std::string_view q) { return foldedName(index).substr(0, q.size()) < q; });
+		auto last = std::upper_bound(first, foldedOrder.end(), q,
+			[&](std::string_view q, uint32_t index) { return q < foldedName(index).substr(0, q.size()); });
+		for (auto it = first; it != last; it++) {
+			consider(*it, 0);
+		}
+		return count;
+	}
+
+	std::vector<uint32_t> grams;
+	for (size_t i = 0; i + 3 <= q.size(); i++) {
+		grams.push_back(gramAt(q, i));
+	}
+	std::sort(grams.begin(), grams.end());
+	grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+	std::vector<uint32_t> touched;
+	for (uint32_t gram : grams) {
+		for (uint32_t i = gramStart[gram]; i < gramStart[gram + 1]; i++) {
+			uint32_t index = gramNames[i];
+			if (gramHits[index]++ == 0) {
+				touched.push_back(index);
+			}
+		}
+	}
+
+	int needed = std::max((int)grams.size() / 2, 1);
+	for (uint32_t index : touched) {
+		if (gramHits[index] >= needed) {
+			consider(index, gramHits[index]);
+		}
+		gramHits[index] = 0;
+	}
+	return count;
+}
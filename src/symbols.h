@@ -0,0 +1,70 @@
+#ifndef INCLUDED_SYMBOLS_H
+#define INCLUDED_SYMBOLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+struct Dromaius;
+
+#define SYMBOLS_BANKS 256
+#define SYMBOLS_GRAM_CHARS 40 // letters ignoring case, digits, '_', '.' and the rest
+#define SYMBOLS_GRAMS (SYMBOLS_GRAM_CHARS * SYMBOLS_GRAM_CHARS * SYMBOLS_GRAM_CHARS)
+
+// Symbols from the .sym file next to the ROM, as written by rgblink: one
+// "bank:addr name" per line, ';' starts a comment. All names are views
+// into the file contents, which are kept as they are.
+struct Symbols
+{
+	typedef struct symbol_s {
+		uint16_t addr;
+		uint8_t bank;
+		std::string_view name;
+	} symbol_t;
+
+	// Up-reference
+	Dromaius *emu;
+
+	std::string pool; // the whole file
+	std::vector<symbol_t> byAddr[SYMBOLS_BANKS]; // per bank, sorted by address
+	std::vector<symbol_t> byName; // sorted by name
+
+	// Fuzzy search index: for each trigram of folded characters, which
+	// names contain it. The lists for all trigrams are stored back to back.
+	std::string folded; // all names in lowercase, in byName order
+	std::vector<uint32_t> foldedStart; // per name into folded, plus the end
+	std::vector<uint32_t> foldedOrder; // indices into byName, by folded name
+	std::vector<uint32_t> gramStart; // per trigram into gramNames, plus the end
+	std::vector<uint32_t> gramNames; // indices into byName, ascending
+	std::vector<uint8_t> gramHits; // per name, scratch space for search
+
+	bool load(std::string const &filename);
+	void clear();
+	size_t size() const { return byName.size(); }
+
+	// Bank the debugger should look in for an address, with the current
+	// banks mapped in
+	uint8_t currentBank(uint16_t addr);
+
+	// Exact lookups, return an empty name or nullptr when there's none
+	std::string_view name(uint8_t bank, uint16_t addr) const;
+	const symbol_t *find(std::string_view name) const;
+
+	// Closest symbol at or before the address in the same bank and memory
+	// region, nullptr if there's none
+	const symbol_t *nearest(uint8_t bank, uint16_t addr) const;
+
+	// Writes the nearest symbol as "name+offset" into buf, which stays
+	// empty when there's no symbol
+	int format(char *buf, size_t len, uint8_t bank, uint16_t addr) const;
+
+	// Best matches for a partial name, typos allowed, best first. Fills
+	// results with indices into byName and returns how many there are.
+	size_t search(std::string_view query, uint32_t *results, size_t max);
+
+private:
+	void buildSearchIndex();
+};
+
+#endif